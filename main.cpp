@@ -3,18 +3,111 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <stdexcept>
+#include <cstdint>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <queue>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Cache prefetch hint; a no-op where the compiler has none
+#if defined(__GNUC__) || defined(__clang__)
+#define ENIGMA_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define ENIGMA_PREFETCH(address) ((void)(address))
+#endif
+
+// Lowest set bit of a nonzero mask, and the number of set bits, with the
+// compiler's instructions where it has them
+inline int lowestSetBit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+inline int setBitCount(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(mask);
+#else
+    int count = 0;
+    for (; mask; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
 
 // Constants
 const int ALPHABET_SIZE = 26;
 const char FIRST_LETTER = 'A';
 
+/**
+ * ASCII letter test and upper-casing, independent of the C locale, so
+ * the bytes of a multibyte UTF-8 sequence are never taken for letters
+ */
+bool isAsciiLetter(char c) {
+    return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+}
+
+char toAsciiUpper(char c) {
+    return static_cast<unsigned char>(c - 'a') < 26 ? static_cast<char>(c - ('a' - 'A')) : c;
+}
+
 /**
  * Utility function to convert character to index (0-25)
  */
 int charToIndex(char c) {
-    return std::toupper(c) - FIRST_LETTER;
+    return toAsciiUpper(c) - FIRST_LETTER;
+}
+
+/**
+ * Letter indices of the letters in a text; anything else is dropped
+ */
+std::vector<std::uint8_t> lettersOf(const std::string& text) {
+    std::vector<std::uint8_t> letters;
+    for (char c : text) {
+        if (isAsciiLetter(c)) {
+            letters.push_back(static_cast<std::uint8_t>(charToIndex(c)));
+        }
+    }
+    return letters;
 }
 
 /**
@@ -24,59 +117,428 @@ char indexToChar(int index) {
     return static_cast<char>(FIRST_LETTER + (index % ALPHABET_SIZE));
 }
 
+/**
+ * Symbol mapping for the classic 26-letter A-Z keyboard
+ */
+struct LatinAlphabet {
+    static const int size = ALPHABET_SIZE;
+    
+    static int toIndex(char c) {
+        return charToIndex(c);
+    }
+    
+    static char toChar(int index) {
+        return static_cast<char>(FIRST_LETTER + index);
+    }
+    
+    static char normalize(char c) {
+        return static_cast<char>(toAsciiUpper(c));
+    }
+    
+    static bool isSymbol(char c) {
+        return isAsciiLetter(c);
+    }
+};
+
+/**
+ * Symbol mapping for 10-digit (numeric) rotor machines
+ */
+struct DigitAlphabet {
+    static const int size = 10;
+    
+    static int toIndex(char c) {
+        return c - '0';
+    }
+    
+    static char toChar(int index) {
+        return static_cast<char>('0' + index);
+    }
+    
+    static char normalize(char c) {
+        return c;
+    }
+    
+    static bool isSymbol(char c) {
+        return c >= '0' && c <= '9';
+    }
+};
+
+/**
+ * Symbol mapping for 32-symbol teleprinter machines, using the
+ * Bletchley Park notation for the six non-letter codes
+ */
+struct TeleprinterAlphabet {
+    static const int size = 32;
+    
+    static int toIndex(char c) {
+        if (isAsciiLetter(c)) {
+            return toAsciiUpper(c) - 'A';
+        }
+        
+        switch (c) {
+            case '/': return 26;
+            case '3': return 27;
+            case '4': return 28;
+            case '5': return 29;
+            case '8': return 30;
+            case '9': return 31;
+            default:  return -1;
+        }
+    }
+    
+    static char toChar(int index) {
+        return index < 26 ? static_cast<char>('A' + index) : "/34589"[index - 26];
+    }
+    
+    static char normalize(char c) {
+        return static_cast<char>(toAsciiUpper(c));
+    }
+    
+    static bool isSymbol(char c) {
+        return toIndex(c) >= 0;
+    }
+};
+
+/**
+ * Modular arithmetic on alphabet indices. The hot path only ever reduces
+ * the sum or difference of two in-range indices, so a single conditional
+ * subtraction replaces '%' (26 letters, 10 digits, ...), and power-of-two
+ * alphabets reduce with a mask.
+ */
+template <int Size, bool PowerOfTwo = (Size & (Size - 1)) == 0>
+struct AlphabetModulus {
+    // Reduce a value in [0, 2 * Size)
+    static int reduce(int value) {
+        return value >= Size ? value - Size : value;
+    }
+    
+    // Reduce an arbitrary (possibly negative) value
+    static int normalize(int value) {
+        value %= Size;
+        return value < 0 ? value + Size : value;
+    }
+};
+
+template <int Size>
+struct AlphabetModulus<Size, true> {
+    static int reduce(int value) {
+        return value & (Size - 1);
+    }
+    
+    static int normalize(int value) {
+        return value & (Size - 1);
+    }
+};
+
+/**
+ * Compose two tables of up to 32 entries: out[i] = second[first[i]],
+ * i.e. apply first, then second. All three hold 32 bytes, with entries
+ * below 32. With SSSE3 each half is two byte shuffles and a blend.
+ */
+inline void composeTables(const std::uint8_t* first, const std::uint8_t* second, std::uint8_t* out) {
+#ifdef __SSSE3__
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + 16));
+    __m128i fifteen = _mm_set1_epi8(15);
+    for (int half = 0; half < 32; half += 16) {
+        __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + half));
+        __m128i useHigh = _mm_cmpgt_epi8(index, fifteen);
+        __m128i result = _mm_or_si128(_mm_and_si128(useHigh, _mm_shuffle_epi8(high, index)),
+                                      _mm_andnot_si128(useHigh, _mm_shuffle_epi8(low, index)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + half), result);
+    }
+#else
+    for (int i = 0; i < 32; i++) {
+        out[i] = second[first[i] & 31];
+    }
+#endif
+}
+
+/**
+ * Permutation of up to 32 symbols, held as a 32-byte image table whose
+ * entries past the size map to themselves, so composing, inverting and
+ * mapping letter sets are whole-table vector operations. Rotor passes,
+ * reflectors, plugboards and compiled scrambler tables are all built or
+ * analysed through it.
+ */
+class Permutation {
+public:
+    static const int MAX_SIZE = 32;
+    
+private:
+    alignas(16) std::uint8_t image[MAX_SIZE];
+    int size;
+    
+public:
+    /**
+     * Identity on size symbols
+     */
+    explicit Permutation(int size = ALPHABET_SIZE) : size(size) {
+        if (size < 1 || size > MAX_SIZE) {
+            throw std::invalid_argument("Permutations hold 1 to 32 symbols");
+        }
+        for (int i = 0; i < MAX_SIZE; i++) {
+            image[i] = static_cast<std::uint8_t>(i);
+        }
+    }
+    
+    /**
+     * From a table of size entries, e.g. a compiled scrambler table; the
+     * entries are trusted to form a permutation
+     */
+    static Permutation fromTable(const std::uint8_t* table, int size) {
+        Permutation result(size);
+        std::copy(table, table + size, result.image);
+        return result;
+    }
+    
+    /**
+     * From a wiring string: symbol i is wired to wiring[i]
+     */
+    template <class Alphabet>
+    static Permutation fromWiring(const std::string& wiring) {
+        Permutation result(Alphabet::size);
+        std::uint32_t seen = 0;
+        for (int i = 0; i < Alphabet::size; i++) {
+            int target = i < static_cast<int>(wiring.size()) ? Alphabet::toIndex(wiring[i]) : -1;
+            if (target < 0 || target >= Alphabet::size || (seen >> target) & 1) {
+                throw std::invalid_argument("Wiring must use every symbol exactly once");
+            }
+            seen |= 1u << target;
+            result.image[i] = static_cast<std::uint8_t>(target);
+        }
+        return result;
+    }
+    
+    /**
+     * Cyclic shift x -> x + offset
+     */
+    static Permutation shift(int size, int offset) {
+        Permutation result(size);
+        offset = ((offset % size) + size) % size;
+        for (int i = 0; i < size; i++) {
+            result.image[i] = static_cast<std::uint8_t>(i + offset < size ? i + offset : i + offset - size);
+        }
+        return result;
+    }
+    
+    template <class Alphabet>
+    std::string toWiring() const {
+        std::string wiring(size, '?');
+        for (int i = 0; i < size; i++) {
+            wiring[i] = Alphabet::toChar(image[i]);
+        }
+        return wiring;
+    }
+    
+    int operator[](int symbol) const {
+        return image[symbol];
+    }
+    
+    bool operator==(const Permutation& other) const {
+        return size == other.size && std::equal(image, image + MAX_SIZE, other.image);
+    }
+    
+    bool operator!=(const Permutation& other) const {
+        return !(*this == other);
+    }
+    
+    int getSize() const {
+        return size;
+    }
+    
+    /**
+     * The full 32-byte table
+     */
+    const std::uint8_t* data() const {
+        return image;
+    }
+    
+    /**
+     * Apply this, then second
+     */
+    Permutation then(const Permutation& second) const {
+        Permutation result(size);
+        composeTables(image, second.image, result.image);
+        return result;
+    }
+    
+    Permutation inverse() const {
+        Permutation result(size);
+#ifdef __SSE2__
+        // Position of each value: one compare per half, then the mask's lowest bit
+        __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(image));
+        __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(image + 16));
+        for (int value = 0; value < size; value++) {
+            __m128i wanted = _mm_set1_epi8(static_cast<char>(value));
+            std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, wanted))) |
+                                 static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, wanted))) << 16;
+            result.image[value] = static_cast<std::uint8_t>(lowestSetBit(mask));
+        }
+#else
+        for (int i = 0; i < size; i++) {
+            result.image[image[i]] = static_cast<std::uint8_t>(i);
+        }
+#endif
+        return result;
+    }
+    
+    /**
+     * Conjugate by a cyclic shift: x -> p(x + offset) - offset, the
+     * permutation of a wheel turned offset steps from its rest position
+     */
+    Permutation shifted(int offset) const {
+        return shift(size, offset).then(*this).then(shift(size, -offset));
+    }
+    
+    /**
+     * Image of a set of symbols (bit i = symbol i), one lookup per member
+     */
+    std::uint32_t imageOf(std::uint32_t set) const {
+        std::uint32_t result = 0;
+        for (; set; set &= set - 1) {
+            result |= 1u << image[lowestSetBit(set)];
+        }
+        return result;
+    }
+    
+    /**
+     * Symbols that this maps into a set. With SSSE3 this is one gather
+     * whatever the set's size; for an involution, such as an Enigma
+     * scrambler, it is also the image of the set.
+     */
+    std::uint32_t preimageOf(std::uint32_t set) const {
+#ifdef __SSSE3__
+        // Spread the set to one byte per symbol, then gather through the table
+        const __m128i select = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+        __m128i bytes[2];
+        for (int half = 0; half < 2; half++) {
+            __m128i spread = _mm_set_epi64x(0x0101010101010101LL * ((set >> (half * 16 + 8)) & 0xFF),
+                                            0x0101010101010101LL * ((set >> (half * 16)) & 0xFF));
+            bytes[half] = _mm_cmpeq_epi8(_mm_and_si128(spread, select), select);
+        }
+        __m128i fifteen = _mm_set1_epi8(15);
+        std::uint32_t result = 0;
+        for (int half = 0; half < 2; half++) {
+            __m128i index = _mm_load_si128(reinterpret_cast<const __m128i*>(image + half * 16));
+            __m128i useHigh = _mm_cmpgt_epi8(index, fifteen);
+            __m128i gathered = _mm_or_si128(_mm_and_si128(useHigh, _mm_shuffle_epi8(bytes[1], index)),
+                                            _mm_andnot_si128(useHigh, _mm_shuffle_epi8(bytes[0], index)));
+            result |= static_cast<std::uint32_t>(_mm_movemask_epi8(gathered)) << (half * 16);
+        }
+        return size == MAX_SIZE ? result : result & ((1u << size) - 1);
+#else
+        std::uint32_t result = 0;
+        for (int i = 0; i < size; i++) {
+            result |= ((set >> image[i]) & 1u) << i;
+        }
+        return result;
+#endif
+    }
+    
+    /**
+     * Cycles, each starting from its lowest symbol, in order of that symbol
+     */
+    std::vector<std::vector<int>> cycles() const {
+        std::vector<std::vector<int>> result;
+        std::uint32_t visited = 0;
+        for (int start = 0; start < size; start++) {
+            if ((visited >> start) & 1) continue;
+            std::vector<int> cycle;
+            for (int symbol = start; !((visited >> symbol) & 1); symbol = image[symbol]) {
+                visited |= 1u << symbol;
+                cycle.push_back(symbol);
+            }
+            result.push_back(cycle);
+        }
+        return result;
+    }
+    
+    /**
+     * Cycle lengths, longest first; unchanged by conjugation, so two
+     * permutations differing only by a relabelling (a plugboard) share it
+     */
+    std::vector<int> cycleType() const {
+        std::vector<int> lengths;
+        for (const auto& cycle : cycles()) {
+            lengths.push_back(static_cast<int>(cycle.size()));
+        }
+        std::sort(lengths.begin(), lengths.end(), std::greater<int>());
+        return lengths;
+    }
+    
+    bool isInvolution() const {
+        return then(*this) == Permutation(size);
+    }
+};
+
 /**
  * Base class for all Enigma components
  */
-class EnigmaComponent {
+template <class Alphabet>
+class BasicEnigmaComponent {
 protected:
+    typedef AlphabetModulus<Alphabet::size> Modulus;
+    
     std::string wiring;
     std::string name;
     int position;
     int ringSetting;
     
 public:
-    EnigmaComponent(const std::string& wiring, const std::string& name = "Component")
+    BasicEnigmaComponent(const std::string& wiring, const std::string& name = "Component")
         : wiring(wiring), name(name), position(0), ringSetting(0) {
-        if (wiring.length() != ALPHABET_SIZE) {
-            throw std::invalid_argument("Wiring must be exactly 26 characters");
+        if (wiring.length() != static_cast<size_t>(Alphabet::size)) {
+            throw std::invalid_argument("Wiring must be exactly " + std::to_string(Alphabet::size) + " characters");
         }
     }
     
-    virtual ~EnigmaComponent() = default;
+    virtual ~BasicEnigmaComponent() = default;
     
     virtual char process(char input, bool forward = true) = 0;
     
     void setPosition(int pos) {
-        position = pos % ALPHABET_SIZE;
+        position = Modulus::normalize(pos);
     }
     
     void setRingSetting(int setting) {
-        ringSetting = setting % ALPHABET_SIZE;
+        ringSetting = Modulus::normalize(setting);
     }
     
     int getPosition() const {
         return position;
     }
     
+    int getRingSetting() const {
+        return ringSetting;
+    }
+    
+    const std::string& getWiring() const {
+        return wiring;
+    }
+    
     std::string getName() const {
         return name;
     }
     
     void rotate() {
-        position = (position + 1) % ALPHABET_SIZE;
+        position = Modulus::reduce(position + 1);
+    }
+    
+    void rotateBack() {
+        position = Modulus::reduce(position - 1 + Alphabet::size);
     }
     
     /**
      * Apply position and ring setting to a signal
      */
     int applyOffset(int signal, bool forward) const {
-        int offset = position - ringSetting;
-        if (offset < 0) offset += ALPHABET_SIZE;
+        int offset = Modulus::reduce(position - ringSetting + Alphabet::size);
         
         if (forward) {
-            signal = (signal + offset) % ALPHABET_SIZE;
+            signal = Modulus::reduce(signal + offset);
         } else {
-            signal = (signal - offset + ALPHABET_SIZE) % ALPHABET_SIZE;
+            signal = Modulus::reduce(signal - offset + Alphabet::size);
         }
         
         return signal;
@@ -86,287 +548,5467 @@ public:
 /**
  * Rotor class - represents a single Enigma rotor
  */
-class Rotor : public EnigmaComponent {
+template <class Alphabet>
+class BasicRotor : public BasicEnigmaComponent<Alphabet> {
+    static_assert(Alphabet::size <= 64, "Notch mask holds at most 64 positions");
+    
 private:
     std::string reverseWiring;
-    int notchPosition;
-    
-    void buildReverseWiring() {
-        reverseWiring.resize(ALPHABET_SIZE);
-        for (int i = 0; i < ALPHABET_SIZE; i++) {
-            char output = wiring[i];
-            int outputIndex = charToIndex(output);
-            reverseWiring[outputIndex] = indexToChar(i);
-        }
-    }
+    std::uint64_t notchMask;
     
 public:
-    Rotor(const std::string& wiring, int notch, const std::string& name = "Rotor")
-        : EnigmaComponent(wiring, name), notchPosition(notch) {
-        buildReverseWiring();
+    BasicRotor(const std::string& wiring, int notch, const std::string& name = "Rotor")
+        : BasicEnigmaComponent<Alphabet>(wiring, name),
+          reverseWiring(Permutation::fromWiring<Alphabet>(wiring).inverse().template toWiring<Alphabet>()),
+          notchMask(0) {
+        setNotch(notch);
     }
     
     char process(char input, bool forward = true) override {
-        int signal = charToIndex(input);
+        int signal = Alphabet::toIndex(input);
         
-        // Apply position and ring setting
-        signal = applyOffset(signal, forward);
+        // Enter through the rotated contacts
+        signal = this->applyOffset(signal, true);
         
         // Apply wiring transformation
         if (forward) {
-            char outputChar = wiring[signal];
-            signal = charToIndex(outputChar);
+            char outputChar = this->wiring[signal];
+            signal = Alphabet::toIndex(outputChar);
         } else {
             char outputChar = reverseWiring[signal];
-            signal = charToIndex(outputChar);
+            signal = Alphabet::toIndex(outputChar);
         }
         
-        // Reverse position and ring setting
-        signal = applyOffset(signal, !forward);
+        // Leave through the rotated contacts, so the backward pass
+        // exactly inverts the forward pass
+        signal = this->applyOffset(signal, false);
         
-        return indexToChar(signal);
+        return Alphabet::toChar(signal);
     }
     
     bool isAtNotch() const {
-        return position == notchPosition;
+        return (notchMask >> this->position) & 1;
     }
     
     void setNotch(int notch) {
-        notchPosition = notch % ALPHABET_SIZE;
+        notchMask = std::uint64_t(1) << BasicEnigmaComponent<Alphabet>::Modulus::normalize(notch);
+    }
+    
+    /**
+     * Add a further notch (Enigma G, T and Typex wheels carry several)
+     */
+    void addNotch(int notch) {
+        notchMask |= std::uint64_t(1) << BasicEnigmaComponent<Alphabet>::Modulus::normalize(notch);
+    }
+    
+    /**
+     * Remove all notches, e.g. for stators and entry wheels
+     */
+    void clearNotches() {
+        notchMask = 0;
+    }
+    
+    std::uint64_t getNotchMask() const {
+        return notchMask;
+    }
+    
+    const std::string& getReverseWiring() const {
+        return reverseWiring;
     }
 };
 
 /**
  * Reflector class - reflects signals back through rotors
  */
-class Reflector : public EnigmaComponent {
+template <class Alphabet>
+class BasicReflector : public BasicEnigmaComponent<Alphabet> {
+private:
+    void validate() const {
+        for (int i = 0; i < Alphabet::size; i++) {
+            int partner = Alphabet::toIndex(this->wiring[i]);
+            if (partner < 0 || partner >= Alphabet::size || partner == i ||
+                Alphabet::toIndex(this->wiring[partner]) != i) {
+                throw std::invalid_argument("Reflector wiring must pair every letter with a different letter");
+            }
+        }
+    }
+    
+public:
+    BasicReflector(const std::string& wiring, const std::string& name = "Reflector")
+        : BasicEnigmaComponent<Alphabet>(wiring, name) {
+        validate();
+    }
+    
+    /**
+     * Build a rewirable reflector (UKW-D) from a complete set of pairs
+     */
+    BasicReflector(const std::vector<std::pair<char, char>>& pairs, const std::string& name = "Reflector")
+        : BasicEnigmaComponent<Alphabet>(std::string(Alphabet::size, '?'), name) {
+        setPairs(pairs);
+    }
+    
+    /**
+     * Rewire a and b to each other; their former partners are paired
+     * together, so the wiring stays a complete pairing
+     */
+    void connect(char a, char b) {
+        int first = Alphabet::toIndex(Alphabet::normalize(a));
+        int second = Alphabet::toIndex(Alphabet::normalize(b));
+        
+        if (first < 0 || first >= Alphabet::size || second < 0 || second >= Alphabet::size || first == second) {
+            throw std::invalid_argument("Reflector can only pair two different letters");
+        }
+        
+        int firstPartner = Alphabet::toIndex(this->wiring[first]);
+        if (firstPartner == second) {
+            return;
+        }
+        int secondPartner = Alphabet::toIndex(this->wiring[second]);
+        
+        this->wiring[first] = Alphabet::toChar(second);
+        this->wiring[second] = Alphabet::toChar(first);
+        this->wiring[firstPartner] = Alphabet::toChar(secondPartner);
+        this->wiring[secondPartner] = Alphabet::toChar(firstPartner);
+    }
+    
+    /**
+     * Replace the whole wiring; every letter must appear in exactly one pair
+     */
+    void setPairs(const std::vector<std::pair<char, char>>& pairs) {
+        std::string rewired(Alphabet::size, '?');
+        
+        for (const auto& pair : pairs) {
+            int a = Alphabet::toIndex(Alphabet::normalize(pair.first));
+            int b = Alphabet::toIndex(Alphabet::normalize(pair.second));
+            
+            if (a < 0 || a >= Alphabet::size || b < 0 || b >= Alphabet::size ||
+                rewired[a] != '?' || rewired[b] != '?') {
+                throw std::invalid_argument("One or both letters are already connected");
+            }
+            
+            rewired[a] = Alphabet::toChar(b);
+            rewired[b] = Alphabet::toChar(a);
+        }
+        
+        std::string previous = this->wiring;
+        this->wiring = rewired;
+        try {
+            validate();
+        } catch (...) {
+            this->wiring = previous;
+            throw;
+        }
+    }
+    
+    std::string getPairs() const {
+        std::string result;
+        
+        for (int i = 0; i < Alphabet::size; i++) {
+            int partner = Alphabet::toIndex(this->wiring[i]);
+            if (i < partner) {
+                result += Alphabet::toChar(i);
+                result += Alphabet::toChar(partner);
+                result += " ";
+            }
+        }
+        
+        return result;
+    }
+    
+    char process(char input, bool /*forward*/ = true) override {
+        // Reflector only works in one direction; settable reflectors
+        // (Enigma G, K, D, T) are offset like a rotor
+        int signal = this->applyOffset(Alphabet::toIndex(input), true);
+        signal = Alphabet::toIndex(this->wiring[signal]);
+        signal = this->applyOffset(signal, false);
+        return Alphabet::toChar(signal);
+    }
+};
+
+/**
+ * Plugboard class - implements the cable connections
+ */
+template <class Alphabet>
+class BasicPlugboard {
+private:
+    // Flat table form: the forward table is applied on the way into the
+    // scrambler and the reverse table on the way back out. Cables keep the
+    // two identical; an Uhr box or other non-reciprocal mapping does not.
+    std::string forwardTable;
+    std::string reverseTable;
+    
 public:
-    Reflector(const std::string& wiring, const std::string& name = "Reflector")
-        : EnigmaComponent(wiring, name) {}
+    BasicPlugboard() {
+        clearConnections();
+    }
     
-    char process(char input, bool forward = true) override {
-        // Reflector only works in one direction
-        int signal = charToIndex(input);
-        char outputChar = wiring[signal];
-        return outputChar;
+    void connect(char a, char b) {
+        a = Alphabet::normalize(a);
+        b = Alphabet::normalize(b);
+        int first = Alphabet::toIndex(a);
+        int second = Alphabet::toIndex(b);
+        
+        if (first < 0 || first >= Alphabet::size || second < 0 || second >= Alphabet::size) {
+            throw std::invalid_argument("Plugboard can only connect letters");
+        }
+        
+        // Check if letters are already connected
+        if (forwardTable[first] != a || forwardTable[second] != b ||
+            reverseTable[first] != a || reverseTable[second] != b) {
+            throw std::invalid_argument("One or both letters are already connected");
+        }
+        
+        forwardTable[first] = b;
+        forwardTable[second] = a;
+        reverseTable[first] = b;
+        reverseTable[second] = a;
+    }
+    
+    void clearConnections() {
+        forwardTable.resize(Alphabet::size);
+        for (int i = 0; i < Alphabet::size; i++) {
+            forwardTable[i] = Alphabet::toChar(i);
+        }
+        reverseTable = forwardTable;
+    }
+    
+    /**
+     * Install an arbitrary (possibly non-reciprocal) mapping; mapping[i]
+     * is where letter i goes on its way into the scrambler
+     */
+    void setPermutation(const std::string& mapping) {
+        if (mapping.size() != static_cast<size_t>(Alphabet::size)) {
+            throw std::invalid_argument("Plugboard mapping must cover the whole alphabet");
+        }
+        
+        std::string forward(Alphabet::size, ' ');
+        std::string reverse(Alphabet::size, ' ');
+        std::vector<bool> used(Alphabet::size, false);
+        
+        for (int i = 0; i < Alphabet::size; i++) {
+            int target = Alphabet::toIndex(Alphabet::normalize(mapping[i]));
+            if (target < 0 || target >= Alphabet::size || used[target]) {
+                throw std::invalid_argument("Plugboard mapping must be a permutation of the alphabet");
+            }
+            used[target] = true;
+            forward[i] = Alphabet::toChar(target);
+            reverse[target] = Alphabet::toChar(i);
+        }
+        
+        forwardTable = forward;
+        reverseTable = reverse;
+    }
+    
+    bool isReciprocal() const {
+        return forwardTable == reverseTable;
+    }
+    
+    const std::string& getPermutation() const {
+        return forwardTable;
+    }
+    
+    char process(char input, bool forward = true) const {
+        input = Alphabet::normalize(input);
+        int index = Alphabet::toIndex(input);
+        
+        // Anything outside the alphabet is returned unchanged
+        if (index < 0 || index >= Alphabet::size) {
+            return input;
+        }
+        
+        return forward ? forwardTable[index] : reverseTable[index];
+    }
+    
+    std::string getConnections() const {
+        std::string result;
+        
+        for (int i = 0; i < Alphabet::size; i++) {
+            int partner = Alphabet::toIndex(forwardTable[i]);
+            
+            if (Alphabet::toIndex(forwardTable[partner]) == i) {
+                // Cable pair, listed once
+                if (i < partner) {
+                    result += Alphabet::toChar(i);
+                    result += forwardTable[i];
+                    result += " ";
+                }
+            } else {
+                // One-way connection through an Uhr box or similar
+                result += Alphabet::toChar(i);
+                result += ">";
+                result += forwardTable[i];
+                result += " ";
+            }
+        }
+        
+        return result;
+    }
+};
+
+/**
+ * How the moving wheels are driven. Both are this simulator's models
+ * rather than the historical mechanisms: a wheel carries its neighbour
+ * when it steps onto a notch instead of off it, and the ratchet moves the
+ * left wheel with the middle one. Unlike the real double step, each is a
+ * permutation of the wheel positions, which unstep(), backward
+ * decryption and the compiled engine's state seeks rely on. Output
+ * matches historical machines only while no wheel but the right one
+ * moves.
+ */
+enum class SteppingMode {
+    Ratchet,    // Pawl and ratchet model (Enigma I, K, D, T, Typex)
+    CogWheel    // Gear-driven odometer including the reflector (Enigma G)
+};
+
+/**
+ * Main Enigma Machine class
+ */
+template <class Alphabet>
+class BasicEnigmaMachine {
+public:
+    typedef BasicRotor<Alphabet> RotorType;
+    typedef BasicReflector<Alphabet> ReflectorType;
+    typedef BasicPlugboard<Alphabet> PlugboardType;
+    
+private:
+    std::vector<RotorType> rotors;
+    std::vector<RotorType> stators;
+    ReflectorType reflector;
+    PlugboardType plugboard;
+    SteppingMode steppingMode;
+    
+    // Rotate the rotors according to Enigma stepping mechanism
+    void rotateRotors() {
+        if (steppingMode == SteppingMode::CogWheel) {
+            rotateCogWheels();
+            return;
+        }
+        
+        // Always rotate the rightmost rotor
+        rotors[2].rotate();
+        
+        // Check for double-stepping and notch positions
+        bool rotateMiddle = rotors[2].isAtNotch();
+        bool rotateLeft = rotors[1].isAtNotch();
+        
+        // Double-stepping mechanism
+        if (rotateMiddle) {
+            rotors[1].rotate();
+            rotors[0].rotate(); // Left rotor also rotates when middle rotor is at notch
+        }
+        
+        // Normal notch-triggered rotation
+        if (rotateLeft) {
+            rotors[0].rotate();
+        }
+    }
+    
+    // Odometer stepping: a wheel stepping onto a notch carries its left
+    // neighbour, and the leftmost wheel carries the reflector
+    void rotateCogWheels() {
+        rotors[2].rotate();
+        if (!rotors[2].isAtNotch()) return;
+        
+        rotors[1].rotate();
+        if (!rotors[1].isAtNotch()) return;
+        
+        rotors[0].rotate();
+        if (rotors[0].isAtNotch()) {
+            reflector.rotate();
+        }
+    }
+    
+    // Exact inverse of rotateRotors(): whether the right wheel carried
+    // shows in its new position, and the left wheel's extra step in the
+    // middle wheel's old one
+    void unrotateRotors() {
+        if (steppingMode == SteppingMode::CogWheel) {
+            bool carryMiddle = rotors[2].isAtNotch();
+            bool carryLeft = carryMiddle && rotors[1].isAtNotch();
+            if (carryLeft && rotors[0].isAtNotch()) {
+                reflector.rotateBack();
+            }
+            if (carryLeft) {
+                rotors[0].rotateBack();
+            }
+            if (carryMiddle) {
+                rotors[1].rotateBack();
+            }
+            rotors[2].rotateBack();
+            return;
+        }
+        
+        bool rotatedMiddle = rotors[2].isAtNotch();
+        rotors[2].rotateBack();
+        if (rotatedMiddle) {
+            rotors[1].rotateBack();
+            rotors[0].rotateBack();
+        }
+        if (rotors[1].isAtNotch()) {
+            rotors[0].rotateBack();
+        }
+    }
+    
+public:
+    BasicEnigmaMachine(const std::vector<RotorType>& rotors, const ReflectorType& reflector)
+        : rotors(rotors), reflector(reflector), steppingMode(SteppingMode::Ratchet) {
+        if (rotors.size() != 3) {
+            throw std::invalid_argument("Enigma machine requires exactly 3 rotors");
+        }
+    }
+    
+    char encryptChar(char input) {
+        // Step 1: Rotate rotors before encryption
+        rotateRotors();
+        
+        return scramble(input);
+    }
+    
+    /**
+     * Signal path at the current wheel positions, without stepping
+     */
+    char scramble(char input) {
+        // Step 2: Plugboard transformation
+        char result = plugboard.process(input);
+        
+        // Step 3: Forward pass through stators and rotors (right to left)
+        result = forwardPass(result);
+        
+        // Step 4: Reflector
+        result = reflector.process(result);
+        
+        // Step 5: Backward pass through rotors (left to right)
+        result = backwardPass(result);
+        
+        // Step 6: Plugboard again, in reverse (matters for the Uhr box)
+        result = plugboard.process(result, false);
+        
+        return result;
+    }
+    
+    /**
+     * Signal path from the plugboard to the reflector, at the current
+     * wheel positions (no stepping)
+     */
+    char forwardPass(char input) {
+        for (int i = stators.size() - 1; i >= 0; i--) {
+            input = stators[i].process(input, true);
+        }
+        for (int i = rotors.size() - 1; i >= 0; i--) {
+            input = rotors[i].process(input, true);
+        }
+        return input;
+    }
+    
+    /**
+     * Signal path from the reflector back to the plugboard
+     */
+    char backwardPass(char input) {
+        for (size_t i = 0; i < rotors.size(); i++) {
+            input = rotors[i].process(input, false);
+        }
+        for (size_t i = 0; i < stators.size(); i++) {
+            input = stators[i].process(input, false);
+        }
+        return input;
+    }
+    
+    std::string encrypt(const std::string& message) {
+        std::string result(message);
+        encryptInPlace(result);
+        return result;
+    }
+    
+    /**
+     * Encrypt the letters of a caller's buffer where they lie
+     */
+    void encryptInPlace(char* text, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            // Non-alphabetic characters are left unchanged
+            if (Alphabet::isSymbol(text[i])) {
+                text[i] = encryptChar(text[i]);
+            }
+        }
+    }
+    
+    void encryptInPlace(std::string& text) {
+        if (!text.empty()) {
+            encryptInPlace(&text[0], text.size());
+        }
+    }
+    
+    /**
+     * Advance the moving wheels by one key press without encrypting
+     */
+    void step() {
+        rotateRotors();
+    }
+    
+    /**
+     * Take back one key press: the positions before the last step()
+     */
+    void unstep() {
+        unrotateRotors();
+    }
+    
+    /**
+     * Encrypt a text whose last letter was keyed at the current positions,
+     * from the end backwards, leaving the machine where the text began
+     */
+    void encryptInPlaceBackward(char* text, size_t length) {
+        for (size_t i = length; i-- > 0; ) {
+            if (Alphabet::isSymbol(text[i])) {
+                text[i] = scramble(text[i]);
+                unrotateRotors();
+            }
+        }
+    }
+    
+    std::string encryptBackward(const std::string& message) {
+        std::string result(message);
+        if (!result.empty()) {
+            encryptInPlaceBackward(&result[0], result.size());
+        }
+        return result;
+    }
+    
+    void setRotorPositions(int left, int middle, int right) {
+        rotors[0].setPosition(left);
+        rotors[1].setPosition(middle);
+        rotors[2].setPosition(right);
+    }
+    
+    void setReflectorPosition(int position) {
+        reflector.setPosition(position);
+    }
+    
+    /**
+     * Swap in a different (e.g. rewired UKW-D) reflector, keeping its
+     * current position
+     */
+    void setReflector(const ReflectorType& newReflector) {
+        int position = reflector.getPosition();
+        reflector = newReflector;
+        reflector.setPosition(position);
+    }
+    
+    /**
+     * Install stationary wheels between the plugboard and the moving
+     * rotors, listed left to right (Typex stators, entry wheels)
+     */
+    void setStators(const std::vector<RotorType>& newStators) {
+        stators = newStators;
+    }
+    
+    void setSteppingMode(SteppingMode mode) {
+        steppingMode = mode;
+    }
+    
+    SteppingMode getSteppingMode() const {
+        return steppingMode;
+    }
+    
+    void setRingSettings(int left, int middle, int right) {
+        rotors[0].setRingSetting(left);
+        rotors[1].setRingSetting(middle);
+        rotors[2].setRingSetting(right);
+    }
+    
+    void setPlugboardConnections(const std::vector<std::pair<char, char>>& connections) {
+        plugboard.clearConnections();
+        for (const auto& connection : connections) {
+            plugboard.connect(connection.first, connection.second);
+        }
+    }
+    
+    void setPlugboard(const PlugboardType& newPlugboard) {
+        plugboard = newPlugboard;
+    }
+    
+    /**
+     * Settable state in a trivially copyable form: wheel positions, the
+     * reflector position, rings and the plugboard mapping. Stators and
+     * wirings are not included; restore a snapshot only into the machine
+     * it came from or a copy of it.
+     */
+    struct Snapshot {
+        std::uint8_t positions[3];
+        std::uint8_t rings[3];
+        std::uint8_t reflectorPosition;
+        char plugboard[Alphabet::size];
+    };
+    static_assert(std::is_trivially_copyable<Snapshot>::value, "Snapshots are copied as plain bytes");
+    
+    Snapshot snapshot() const {
+        Snapshot result;
+        for (int i = 0; i < 3; i++) {
+            result.positions[i] = static_cast<std::uint8_t>(rotors[i].getPosition());
+            result.rings[i] = static_cast<std::uint8_t>(rotors[i].getRingSetting());
+        }
+        result.reflectorPosition = static_cast<std::uint8_t>(reflector.getPosition());
+        std::memcpy(result.plugboard, plugboard.getPermutation().data(), Alphabet::size);
+        return result;
+    }
+    
+    /**
+     * Return to a snapshot; the plugboard is only rebuilt if it differs
+     */
+    void restore(const Snapshot& saved) {
+        for (int i = 0; i < 3; i++) {
+            rotors[i].setPosition(saved.positions[i]);
+            rotors[i].setRingSetting(saved.rings[i]);
+        }
+        reflector.setPosition(saved.reflectorPosition);
+        if (std::memcmp(saved.plugboard, plugboard.getPermutation().data(), Alphabet::size) != 0) {
+            plugboard.setPermutation(std::string(saved.plugboard, Alphabet::size));
+        }
+    }
+    
+    std::string getCurrentState() const {
+        std::string state;
+        state += "Rotor Positions: ";
+        state += Alphabet::toChar(rotors[0].getPosition());
+        state += Alphabet::toChar(rotors[1].getPosition());
+        state += Alphabet::toChar(rotors[2].getPosition());
+        state += "\nPlugboard: " + plugboard.getConnections();
+        return state;
+    }
+    
+    PlugboardType& getPlugboard() {
+        return plugboard;
+    }
+    
+    const PlugboardType& getPlugboard() const {
+        return plugboard;
+    }
+    
+    const std::vector<RotorType>& getRotors() const {
+        return rotors;
+    }
+    
+    const std::vector<RotorType>& getStators() const {
+        return stators;
+    }
+    
+    const ReflectorType& getReflector() const {
+        return reflector;
+    }
+};
+
+/**
+ * States in the order the stepping visits them: each cycle of the
+ * transition table walked from its lowest state, cycles one after
+ * another. Laying tables out in this order puts consecutive key presses
+ * in adjacent memory.
+ */
+std::vector<std::uint32_t> steppingOrder(const std::vector<std::uint32_t>& next) {
+    std::vector<std::uint32_t> order;
+    std::vector<bool> visited(next.size(), false);
+    order.reserve(next.size());
+    
+    for (std::uint32_t start = 0; start < next.size(); start++) {
+        for (std::uint32_t state = start; !visited[state]; state = next[state]) {
+            visited[state] = true;
+            order.push_back(state);
+        }
+    }
+    
+    return order;
+}
+
+/**
+ * Where a TableStorage block ended up
+ */
+enum class PageBacking { HugeTlb, TransparentHuge, Normal, File };
+
+/**
+ * Zero-initialized array for large lookup tables, optionally on 2 MB
+ * pages so random access across tens of megabytes does not thrash the
+ * TLB. Huge pages are tried from the reserved pool (MAP_HUGETLB) first,
+ * then as transparent huge pages (MADV_HUGEPAGE), and ordinary memory is
+ * the last resort; getBacking() tells which one was used. Copies ask for
+ * the same kind of pages as the original.
+ */
+template <class T>
+class TableStorage {
+private:
+    static const size_t HUGE_PAGE = 2 << 20;
+    
+    T* data;
+    size_t count;
+    size_t bytes;       // mapped length, when mapped
+    bool hugePages;
+    bool mapped;
+    PageBacking backing;
+    
+    void allocate() {
+        data = nullptr;
+        bytes = 0;
+        mapped = false;
+        backing = PageBacking::Normal;
+        if (!count) return;
+        
+#ifdef __linux__
+        if (hugePages) {
+            size_t rounded = (count * sizeof(T) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+            void* block = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            block = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            backing = PageBacking::HugeTlb;
+#endif
+            if (block == MAP_FAILED) {
+                // Over-map and trim to a 2 MB boundary, so whole huge pages fit
+                char* raw = static_cast<char*>(mmap(nullptr, rounded + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                block = raw;
+                if (block != MAP_FAILED) {
+                    size_t head = (HUGE_PAGE - reinterpret_cast<std::uintptr_t>(raw) % HUGE_PAGE) % HUGE_PAGE;
+                    if (head) {
+                        munmap(raw, head);
+                    }
+                    munmap(raw + head + rounded, HUGE_PAGE - head);
+                    block = raw + head;
+                }
+                backing = PageBacking::Normal;
+#ifdef MADV_HUGEPAGE
+                if (block != MAP_FAILED && madvise(block, rounded, MADV_HUGEPAGE) == 0) {
+                    backing = PageBacking::TransparentHuge;
+                }
+#endif
+            }
+            if (block != MAP_FAILED) {
+                data = static_cast<T*>(block);
+                bytes = rounded;
+                mapped = true;
+                return;
+            }
+            backing = PageBacking::Normal;
+        }
+#endif
+        data = new T[count]();
+    }
+    
+    void release() {
+#ifdef __linux__
+        if (mapped) {
+            munmap(data, bytes);
+            return;
+        }
+#endif
+        delete[] data;
+    }
+    
+public:
+    explicit TableStorage(size_t count = 0, bool hugePages = false)
+        : count(count), hugePages(hugePages) {
+        allocate();
+    }
+    
+    /**
+     * Table read from a file at a page-aligned offset: mapped copy-on-write
+     * where mmap is available, read into memory otherwise. A file too short
+     * to hold the table is rejected before mapping, since touching pages
+     * past its end would raise SIGBUS.
+     */
+    TableStorage(const std::string& path, size_t offset, size_t count)
+        : data(nullptr), count(count), bytes(0), hugePages(false), mapped(false), backing(PageBacking::File) {
+#ifdef __linux__
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size < 0 ||
+                static_cast<std::uint64_t>(info.st_size) < static_cast<std::uint64_t>(offset) + count * sizeof(T)) {
+                close(fd);
+                throw std::runtime_error("Truncated table file " + path);
+            }
+            void* block = mmap(nullptr, count * sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+            close(fd);
+            if (block != MAP_FAILED) {
+                data = static_cast<T*>(block);
+                bytes = count * sizeof(T);
+                mapped = true;
+                return;
+            }
+        }
+#endif
+        std::ifstream file(path, std::ios::binary);
+        data = new T[count]();
+        backing = PageBacking::Normal;
+        if (!file.seekg(offset) || !file.read(reinterpret_cast<char*>(data), count * sizeof(T))) {
+            delete[] data;
+            throw std::runtime_error("Cannot read table file " + path);
+        }
+    }
+    
+    TableStorage(const TableStorage& other)
+        : count(other.count), hugePages(other.hugePages) {
+        allocate();
+        std::copy(other.data, other.data + count, data);
+    }
+    
+    TableStorage& operator=(TableStorage other) {
+        std::swap(data, other.data);
+        std::swap(count, other.count);
+        std::swap(bytes, other.bytes);
+        std::swap(hugePages, other.hugePages);
+        std::swap(mapped, other.mapped);
+        std::swap(backing, other.backing);
+        return *this;
+    }
+    
+    ~TableStorage() {
+        release();
+    }
+    
+    T& operator[](size_t index) {
+        return data[index];
+    }
+    
+    const T& operator[](size_t index) const {
+        return data[index];
+    }
+    
+    size_t size() const {
+        return count;
+    }
+    
+    PageBacking getBacking() const {
+        return backing;
+    }
+};
+
+/**
+ * Order of a compiled engine's states in memory
+ */
+enum class TableLayout { SteppingOrder, Positional };
+
+/**
+ * Table-compiled Enigma engine. Every wheel position reachable by the
+ * stepping mechanism gets a precomputed scrambler table (stators, rotors
+ * and reflector collapsed into one permutation), and stepping becomes a
+ * single transition-table lookup, so each letter costs three table reads
+ * whatever the variant. Output is identical to BasicEnigmaMachine.
+ *
+ * States are numbered, and their tables stored, in the order the
+ * stepping visits them, so a message usually moves to the next state
+ * number and the next table in memory. The positional layout
+ * ((reflector * N + left) * N + middle) * N + right is kept for
+ * comparison; either way, state numbers are only meaningful to the
+ * engine that issued them, and stateIndex() and getRotorPosition()
+ * convert to and from wheel positions.
+ */
+template <class Alphabet>
+class BasicCompiledEnigma {
+public:
+    typedef BasicEnigmaMachine<Alphabet> MachineType;
+    typedef std::uint8_t Symbol;
+    
+private:
+    static const int N = Alphabet::size;
+    static_assert(N <= Permutation::MAX_SIZE, "Compiled tables hold at most 32 symbols");
+    typedef AlphabetModulus<N> Modulus;
+    
+    // Table file layout: header, next[], positionsOfState[], scrambler at a page boundary
+    static const std::uint32_t FILE_VERSION = 1;
+    static const size_t FILE_ALIGNMENT = 4096;
+    
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t symbols;
+        std::uint32_t numStates;
+        std::uint32_t rotatingReflector;
+        std::uint64_t key;
+        std::uint64_t scramblerOffset;
+    };
+    
+    bool rotatingReflector;
+    std::uint32_t numStates;
+    std::uint32_t state;
+    std::vector<std::uint32_t> next;
+    std::vector<std::uint32_t> prev;
+    std::vector<std::uint32_t> cycleStarts;         // first state of each cycle, then numStates
+    std::vector<std::uint32_t> stateOfPositions;    // positional index -> state
+    std::vector<std::uint32_t> positionsOfState;    // state -> positional index
+    TableStorage<Symbol> scrambler;
+    Symbol plugIn[N];
+    Symbol plugOut[N];
+    
+    // A wheel's wiring seen at each offset from its rest position
+    static std::vector<Permutation> offsetPermutations(const std::string& wiring) {
+        Permutation rest = Permutation::fromWiring<Alphabet>(wiring);
+        std::vector<Permutation> table;
+        for (int offset = 0; offset < N; offset++) {
+            table.push_back(rest.shifted(offset));
+        }
+        return table;
+    }
+    
+    // Whether a table read from a file maps [0, numStates) onto itself
+    bool isPermutationOfStates(const std::vector<std::uint32_t>& table) const {
+        std::vector<bool> seen(numStates, false);
+        for (std::uint32_t value : table) {
+            if (value >= numStates || seen[value]) return false;
+            seen[value] = true;
+        }
+        return true;
+    }
+    
+    // Inverse of the transition table (the stepping of every supported
+    // machine is a permutation of its states), and where each cycle
+    // starts if, as in stepping order, every cycle is a run of
+    // consecutive states; cycleStarts stays empty otherwise
+    void indexTransitions() {
+        prev.resize(numStates);
+        for (std::uint32_t index = 0; index < numStates; index++) {
+            prev[next[index]] = index;
+        }
+        
+        cycleStarts.clear();
+        std::uint32_t start = 0;
+        for (std::uint32_t index = 0; index < numStates; index++) {
+            if (next[index] == index + 1) continue;
+            if (next[index] != start) {
+                cycleStarts.clear();
+                return;
+            }
+            cycleStarts.push_back(start);
+            start = index + 1;
+        }
+        cycleStarts.push_back(numStates);
+    }
+    
+    static int offsetOf(const BasicEnigmaComponent<Alphabet>& component, int position) {
+        return Modulus::reduce(position - component.getRingSetting() + N);
+    }
+    
+    void setPositions(MachineType& machine, std::uint32_t index) const {
+        int right = index % N; index /= N;
+        int middle = index % N; index /= N;
+        int left = index % N; index /= N;
+        machine.setRotorPositions(left, middle, right);
+        if (rotatingReflector) {
+            machine.setReflectorPosition(index);
+        }
+    }
+    
+    std::uint32_t indexOf(const MachineType& machine) const {
+        const std::vector<typename MachineType::RotorType>& rotors = machine.getRotors();
+        return positionalIndex(rotors[0].getPosition(), rotors[1].getPosition(), rotors[2].getPosition(),
+                               machine.getReflector().getPosition());
+    }
+    
+    std::uint32_t positionalIndex(int left, int middle, int right, int reflectorPosition) const {
+        std::uint32_t index = rotatingReflector ? Modulus::normalize(reflectorPosition) : 0;
+        index = index * N + Modulus::normalize(left);
+        index = index * N + Modulus::normalize(middle);
+        return index * N + Modulus::normalize(right);
+    }
+    
+public:
+    /**
+     * hugePages puts the scrambler tables on 2 MB pages where available
+     */
+    explicit BasicCompiledEnigma(const MachineType& machine, bool hugePages = false,
+                                 TableLayout layout = TableLayout::SteppingOrder)
+        : rotatingReflector(machine.getSteppingMode() == SteppingMode::CogWheel), state(0) {
+        numStates = N * N * N * (rotatingReflector ? N : 1);
+        
+        // Stepping transition table, taken from the machine itself
+        MachineType stepper(machine);
+        std::vector<std::uint32_t> positionalNext(numStates);
+        for (std::uint32_t index = 0; index < numStates; index++) {
+            setPositions(stepper, index);
+            stepper.step();
+            positionalNext[index] = indexOf(stepper);
+        }
+        
+        // Number the states in the chosen layout
+        if (layout == TableLayout::SteppingOrder) {
+            positionsOfState = steppingOrder(positionalNext);
+        } else {
+            positionsOfState.resize(numStates);
+            for (std::uint32_t index = 0; index < numStates; index++) {
+                positionsOfState[index] = index;
+            }
+        }
+        stateOfPositions.resize(numStates);
+        for (std::uint32_t rank = 0; rank < numStates; rank++) {
+            stateOfPositions[positionsOfState[rank]] = rank;
+        }
+        next.resize(numStates);
+        for (std::uint32_t rank = 0; rank < numStates; rank++) {
+            next[rank] = stateOfPositions[positionalNext[positionsOfState[rank]]];
+        }
+        indexTransitions();
+        
+        // Stationary parts of the signal path
+        const std::vector<typename MachineType::RotorType>& rotors = machine.getRotors();
+        std::vector<typename MachineType::RotorType> stators(machine.getStators());
+        Symbol passed[N];
+        for (int signal = 0; signal < N; signal++) {
+            char c = Alphabet::toChar(signal);
+            for (int i = stators.size() - 1; i >= 0; i--) {
+                c = stators[i].process(c, true);
+            }
+            passed[signal] = static_cast<Symbol>(Alphabet::toIndex(c));
+        }
+        Permutation statorIn = Permutation::fromTable(passed, N);
+        Permutation statorOut = statorIn.inverse();
+        setPlugboard(machine.getPlugboard());
+        
+        // Moving parts, one permutation per wheel and offset; the way back
+        // through a wheel is the inverse of the way in
+        std::vector<Permutation> forward[3], backward[3];
+        for (int i = 0; i < 3; i++) {
+            forward[i] = offsetPermutations(rotors[i].getWiring());
+            for (const Permutation& pass : forward[i]) {
+                backward[i].push_back(pass.inverse());
+            }
+        }
+        std::vector<Permutation> reflect = offsetPermutations(machine.getReflector().getWiring());
+        
+        // The right wheel's passes with the stators folded in, per offset
+        std::vector<Permutation> entry, exit;
+        for (int offset = 0; offset < N; offset++) {
+            entry.push_back(statorIn.then(forward[2][offset]));
+            exit.push_back(backward[2][offset].then(statorOut));
+        }
+        
+        // Compose from the reflector outwards in positional order: the
+        // reflector and left wheel part changes every N * N states, the
+        // middle wheel part every N, and each state adds the right wheel
+        scrambler = TableStorage<Symbol>(static_cast<size_t>(numStates) * N, hugePages);
+        Permutation inner(N), core(N);
+        for (std::uint32_t index = 0; index < numStates; index++) {
+            std::uint32_t rest = index;
+            int right = offsetOf(rotors[2], rest % N); rest /= N;
+            int middle = offsetOf(rotors[1], rest % N); rest /= N;
+            int left = offsetOf(rotors[0], rest % N); rest /= N;
+            
+            if (index % (N * N) == 0) {
+                int top = offsetOf(machine.getReflector(),
+                                   rotatingReflector ? rest : machine.getReflector().getPosition());
+                inner = forward[0][left].then(reflect[top]).then(backward[0][left]);
+            }
+            if (index % N == 0) {
+                core = forward[1][middle].then(inner).then(backward[1][middle]);
+            }
+            Permutation table = entry[right].then(core).then(exit[right]);
+            std::copy(table.data(), table.data() + N, &scrambler[static_cast<size_t>(stateOfPositions[index]) * N]);
+        }
+        
+        state = stateOfPositions[indexOf(machine)];
+    }
+    
+    /**
+     * Load tables written by save(). The scrambler is mapped from the file
+     * rather than copied. The key must match the one saved, or the file
+     * is rejected; the plugboard starts empty and the state at zero.
+     */
+    BasicCompiledEnigma(const std::string& path, std::uint64_t key) : state(0) {
+        std::ifstream file(path, std::ios::binary);
+        FileHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::string(header.magic, 7) != "ENIGTBL" || header.version != FILE_VERSION ||
+            header.symbols != static_cast<std::uint32_t>(N) || header.key != key) {
+            throw std::invalid_argument("Not a matching table file: " + path);
+        }
+        
+        // Reject a header whose tables would not fit the file before reading any of them
+        file.seekg(0, std::ios::end);
+        std::uint64_t fileSize = static_cast<std::uint64_t>(file.tellg());
+        std::uint64_t tablesEnd = sizeof(header) + 2 * static_cast<std::uint64_t>(header.numStates) * sizeof(std::uint32_t);
+        if (header.numStates == 0 || header.scramblerOffset % FILE_ALIGNMENT != 0 || header.scramblerOffset < tablesEnd ||
+            fileSize < header.scramblerOffset + static_cast<std::uint64_t>(header.numStates) * N) {
+            throw std::invalid_argument("Truncated table file: " + path);
+        }
+        file.seekg(sizeof(header));
+        
+        rotatingReflector = header.rotatingReflector != 0;
+        numStates = header.numStates;
+        next.resize(numStates);
+        positionsOfState.resize(numStates);
+        if (!file.read(reinterpret_cast<char*>(&next[0]), numStates * sizeof(std::uint32_t)) ||
+            !file.read(reinterpret_cast<char*>(&positionsOfState[0]), numStates * sizeof(std::uint32_t))) {
+            throw std::invalid_argument("Truncated table file: " + path);
+        }
+        
+        // A damaged file whose key still matches must not index past the tables
+        std::uint32_t expectedStates = N * N * N * (rotatingReflector ? N : 1);
+        if (header.rotatingReflector > 1 || numStates != expectedStates ||
+            !isPermutationOfStates(next) || !isPermutationOfStates(positionsOfState)) {
+            throw std::invalid_argument("Corrupt table file: " + path);
+        }
+        indexTransitions();
+        stateOfPositions.resize(numStates);
+        for (std::uint32_t rank = 0; rank < numStates; rank++) {
+            stateOfPositions[positionsOfState[rank]] = rank;
+        }
+        
+        scrambler = TableStorage<Symbol>(path, header.scramblerOffset, static_cast<size_t>(numStates) * N);
+        for (size_t i = 0; i < scrambler.size(); i++) {
+            if (scrambler[i] >= N) {
+                throw std::invalid_argument("Corrupt table file: " + path);
+            }
+        }
+        for (int signal = 0; signal < N; signal++) {
+            plugIn[signal] = plugOut[signal] = static_cast<Symbol>(signal);
+        }
+    }
+    
+    /**
+     * Write the stepping and scrambler tables (not the plugboard) under a
+     * caller-chosen key, via a uniquely named temporary file renamed into
+     * place, so concurrent writers never share a half-written file
+     */
+    void save(const std::string& path, std::uint64_t key) const {
+        const char magic[8] = "ENIGTBL";
+        FileHeader header = {};
+        std::copy(magic, magic + 8, header.magic);
+        header.version = FILE_VERSION;
+        header.symbols = N;
+        header.numStates = numStates;
+        header.rotatingReflector = rotatingReflector;
+        header.key = key;
+        size_t tablesEnd = sizeof(header) + 2 * numStates * sizeof(std::uint32_t);
+        header.scramblerOffset = (tablesEnd + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+        
+#ifdef __linux__
+        std::vector<char> pattern(path.begin(), path.end());
+        const char suffix[] = ".XXXXXX";
+        pattern.insert(pattern.end(), suffix, suffix + sizeof(suffix));
+        int fd = mkstemp(pattern.data());
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create temporary file for " + path);
+        }
+        fchmod(fd, 0644);   // mkstemp creates 0600; cache files are shared like their directory
+        close(fd);
+        std::string temporary(pattern.data());
+#else
+        std::string temporary = path + ".tmp";
+#endif
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(&next[0]), numStates * sizeof(std::uint32_t));
+            file.write(reinterpret_cast<const char*>(&positionsOfState[0]), numStates * sizeof(std::uint32_t));
+            std::vector<char> padding(header.scramblerOffset - tablesEnd, 0);
+            file.write(padding.data(), padding.size());
+            file.write(reinterpret_cast<const char*>(&scrambler[0]), static_cast<size_t>(numStates) * N);
+            if (!file) {
+                std::remove(temporary.c_str());
+                throw std::runtime_error("Cannot write table file " + temporary);
+            }
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Cannot rename table file to " + path);
+        }
+    }
+    
+    /**
+     * Swap in new plugboard cabling (or an Uhr box setting) without
+     * recompiling the scrambler
+     */
+    void setPlugboard(const typename MachineType::PlugboardType& plugboard) {
+        for (int signal = 0; signal < N; signal++) {
+            plugIn[signal] = static_cast<Symbol>(Alphabet::toIndex(plugboard.process(Alphabet::toChar(signal), true)));
+            plugOut[signal] = static_cast<Symbol>(Alphabet::toIndex(plugboard.process(Alphabet::toChar(signal), false)));
+        }
+    }
+    
+    /**
+     * State for a set of wheel positions
+     */
+    std::uint32_t stateIndex(int left, int middle, int right, int reflectorPosition = 0) const {
+        return stateOfPositions[positionalIndex(left, middle, right, reflectorPosition)];
+    }
+    
+    /**
+     * State for a positional index ((reflector * N + left) * N + middle) * N + right
+     */
+    std::uint32_t stateOfPositionalIndex(std::uint32_t index) const {
+        return stateOfPositions[index];
+    }
+    
+    void setRotorPositions(int left, int middle, int right) {
+        state = stateIndex(left, middle, right, getReflectorPosition());
+    }
+    
+    void setReflectorPosition(int position) {
+        if (rotatingReflector) {
+            state = stateIndex(getRotorPosition(0), getRotorPosition(1), getRotorPosition(2), position);
+        }
+    }
+    
+    /**
+     * Position of rotor 0 (left) to 2 (right) in a state
+     */
+    int rotorPositionOf(std::uint32_t index, int rotor) const {
+        index = positionsOfState[index];
+        for (int i = 2; i > rotor; i--) {
+            index /= N;
+        }
+        return index % N;
+    }
+    
+    int reflectorPositionOf(std::uint32_t index) const {
+        return rotatingReflector ? static_cast<int>(positionsOfState[index] / (N * N * N)) : 0;
+    }
+    
+    /**
+     * Position of rotor 0 (left) to 2 (right) in the current state
+     */
+    int getRotorPosition(int rotor) const {
+        return rotorPositionOf(state, rotor);
+    }
+    
+    int getReflectorPosition() const {
+        return reflectorPositionOf(state);
+    }
+    
+    std::uint32_t getState() const {
+        return state;
+    }
+    
+    void setState(std::uint32_t index) {
+        state = index;
+    }
+    
+    std::uint32_t getNumStates() const {
+        return numStates;
+    }
+    
+    PageBacking getTableBacking() const {
+        return scrambler.getBacking();
+    }
+    
+    std::uint32_t nextState(std::uint32_t index) const {
+        return next[index];
+    }
+    
+    /**
+     * The state a key press leaves from to reach this one
+     */
+    std::uint32_t previousState(std::uint32_t index) const {
+        return prev[index];
+    }
+    
+    /**
+     * Take back one key press
+     */
+    void unstep() {
+        state = prev[state];
+    }
+    
+    /**
+     * The state a number of key presses after (negative: before) a state.
+     * In stepping order a state's cycle is a run of ranks, so this is a
+     * search over the cycles and a modular offset; the positional layout
+     * walks the transition tables.
+     */
+    std::uint32_t advance(std::uint32_t index, std::int64_t presses) const {
+        if (cycleStarts.empty()) {
+            for (; presses > 0; presses--) {
+                index = next[index];
+            }
+            for (; presses < 0; presses++) {
+                index = prev[index];
+            }
+            return index;
+        }
+        
+        auto end = std::upper_bound(cycleStarts.begin(), cycleStarts.end(), index);
+        std::uint32_t first = *(end - 1);
+        std::int64_t length = *end - first;
+        std::int64_t offset = (static_cast<std::int64_t>(index - first) + presses % length + length) % length;
+        return first + static_cast<std::uint32_t>(offset);
+    }
+    
+    /**
+     * Scrambler permutation (between the plugboard passes) for a state
+     */
+    const Symbol* scramblerTable(std::uint32_t index) const {
+        return &scrambler[static_cast<size_t>(index) * N];
+    }
+    
+    /**
+     * Plugboard table on the way in (forward) or out of the scrambler
+     */
+    const Symbol* plugTable(bool forward) const {
+        return forward ? plugIn : plugOut;
+    }
+    
+    int encryptIndex(int signal) {
+        state = next[state];
+        return plugOut[scrambler[static_cast<size_t>(state) * N + plugIn[signal]]];
+    }
+    
+    /**
+     * Encrypt a buffer of alphabet indices (letters only, no pass-through)
+     */
+    void encryptBlock(const Symbol* input, Symbol* output, size_t length) {
+        std::uint32_t current = state;
+        for (size_t i = 0; i < length; i++) {
+            current = next[current];
+            output[i] = plugOut[scrambler[static_cast<size_t>(current) * N + plugIn[input[i]]]];
+        }
+        state = current;
+    }
+    
+    char encryptChar(char input) {
+        return Alphabet::toChar(encryptIndex(Alphabet::toIndex(input)));
+    }
+    
+    std::string encrypt(const std::string& message) {
+        std::string result(message);
+        encryptInPlace(result);
+        return result;
+    }
+    
+    /**
+     * Encrypt the letters of a caller's buffer where they lie, leaving
+     * everything else as encrypt() passes it through
+     */
+    void encryptInPlace(char* text, size_t length) {
+        std::uint32_t current = state;
+        for (size_t i = 0; i < length; i++) {
+            if (Alphabet::isSymbol(text[i])) {
+                current = next[current];
+                int signal = plugIn[Alphabet::toIndex(text[i])];
+                text[i] = Alphabet::toChar(plugOut[scrambler[static_cast<size_t>(current) * N + signal]]);
+            }
+        }
+        state = current;
+    }
+    
+    void encryptInPlace(std::string& text) {
+        if (!text.empty()) {
+            encryptInPlace(&text[0], text.size());
+        }
+    }
+    
+    /**
+     * Backward counterparts of encryptBlock() and encryptInPlace(): the
+     * text's last letter was keyed at the current state, and the engine
+     * ends where the text began. Stepping-ordered tables are then read
+     * in descending order, at the same cost as forwards.
+     */
+    void encryptBlockBackward(const Symbol* input, Symbol* output, size_t length) {
+        std::uint32_t current = state;
+        for (size_t i = length; i-- > 0; ) {
+            output[i] = plugOut[scrambler[static_cast<size_t>(current) * N + plugIn[input[i]]]];
+            current = prev[current];
+        }
+        state = current;
+    }
+    
+    void encryptInPlaceBackward(char* text, size_t length) {
+        std::uint32_t current = state;
+        for (size_t i = length; i-- > 0; ) {
+            if (Alphabet::isSymbol(text[i])) {
+                int signal = plugIn[Alphabet::toIndex(text[i])];
+                text[i] = Alphabet::toChar(plugOut[scrambler[static_cast<size_t>(current) * N + signal]]);
+                current = prev[current];
+            }
+        }
+        state = current;
+    }
+    
+    std::string encryptBackward(const std::string& message) {
+        std::string result(message);
+        if (!result.empty()) {
+            encryptInPlaceBackward(&result[0], result.size());
+        }
+        return result;
+    }
+};
+
+/**
+ * Key stream - the sequence of per-position machine permutations for N
+ * key presses from a starting state, independent of any message. Stored
+ * compactly as state indices into the compiled engine's scrambler tables
+ * (the engine must outlive the stream), or optionally materialized as one
+ * N-byte table per position including the plugboard. One stream can then
+ * encrypt or analyse any number of texts sent on the same key.
+ */
+template <class Alphabet>
+class BasicKeyStream {
+public:
+    typedef BasicCompiledEnigma<Alphabet> EngineType;
+    typedef std::uint8_t Symbol;
+    
+private:
+    static const int N = Alphabet::size;
+    
+    const EngineType* engine;
+    std::vector<std::uint32_t> states;
+    std::vector<Symbol> tables;
+    Symbol plugIn[N];
+    Symbol plugOut[N];
+    
+public:
+    /**
+     * Generate the stream for the engine's current state and plugboard;
+     * the engine itself is not advanced
+     */
+    BasicKeyStream(const EngineType& engine, size_t steps, bool materializeTables = false)
+        : engine(&engine), states(steps) {
+        std::copy(engine.plugTable(true), engine.plugTable(true) + N, plugIn);
+        std::copy(engine.plugTable(false), engine.plugTable(false) + N, plugOut);
+        
+        std::uint32_t state = engine.getState();
+        for (size_t t = 0; t < steps; t++) {
+            state = engine.nextState(state);
+            states[t] = state;
+        }
+        
+        if (materializeTables) {
+            tables.resize(steps * N);
+            for (size_t t = 0; t < steps; t++) {
+                permutation(t, &tables[t * N]);
+            }
+        }
+    }
+    
+    size_t size() const {
+        return states.size();
+    }
+    
+    bool hasTables() const {
+        return !tables.empty();
+    }
+    
+    /**
+     * Scrambler state index used at position t
+     */
+    std::uint32_t state(size_t t) const {
+        return states[t];
+    }
+    
+    /**
+     * Materialized machine permutation for position t (requires tables)
+     */
+    const Symbol* table(size_t t) const {
+        return &tables[t * N];
+    }
+    
+    /**
+     * Write the full machine permutation for position t to out[0..N)
+     */
+    void permutation(size_t t, Symbol* out) const {
+        const Symbol* scrambler = engine->scramblerTable(states[t]);
+        for (int signal = 0; signal < N; signal++) {
+            out[signal] = plugOut[scrambler[plugIn[signal]]];
+        }
+    }
+    
+    int encryptIndex(size_t t, int signal) const {
+        if (!tables.empty()) {
+            return tables[t * N + signal];
+        }
+        return plugOut[engine->scramblerTable(states[t])[plugIn[signal]]];
+    }
+    
+    /**
+     * Encrypt (or decrypt) a text whose first letter falls on position
+     * offset; non-alphabetic characters pass through unchanged
+     */
+    std::string apply(const std::string& text, size_t offset = 0) const {
+        std::string result;
+        result.reserve(text.size());
+        size_t t = offset;
+        
+        for (char c : text) {
+            if (!Alphabet::isSymbol(c)) {
+                result += c;
+                continue;
+            }
+            if (t >= states.size()) {
+                throw std::out_of_range("Text is longer than the key stream");
+            }
+            result += Alphabet::toChar(encryptIndex(t++, Alphabet::toIndex(c)));
+        }
+        
+        return result;
+    }
+};
+
+/**
+ * Batch engine - many keys (start state plus plugboard) sharing one
+ * compiled scrambler set, each lane encrypting its own index buffers.
+ * The engine must outlive the batch.
+ */
+template <class Alphabet>
+class BasicEnigmaBatch {
+public:
+    typedef BasicCompiledEnigma<Alphabet> EngineType;
+    typedef std::uint8_t Symbol;
+    
+    // Lanes interleaved per letter by encryptLanes
+    static const size_t GROUP = 8;
+    
+private:
+    static const int N = Alphabet::size;
+    
+    struct Lane {
+        std::uint32_t state;
+        Symbol plugIn[N];
+        Symbol plugOut[N];
+    };
+    
+    const EngineType* engine;
+    std::vector<Lane> lanes;
+    
+public:
+    explicit BasicEnigmaBatch(const EngineType& engine)
+        : engine(&engine) {}
+    
+    /**
+     * Add a key; returns its lane number
+     */
+    size_t addKey(std::uint32_t state, const typename EngineType::MachineType::PlugboardType& plugboard) {
+        Lane lane;
+        lane.state = state;
+        for (int signal = 0; signal < N; signal++) {
+            lane.plugIn[signal] = static_cast<Symbol>(Alphabet::toIndex(plugboard.process(Alphabet::toChar(signal), true)));
+            lane.plugOut[signal] = static_cast<Symbol>(Alphabet::toIndex(plugboard.process(Alphabet::toChar(signal), false)));
+        }
+        lanes.push_back(lane);
+        return lanes.size() - 1;
+    }
+    
+    size_t size() const {
+        return lanes.size();
+    }
+    
+    void clear() {
+        lanes.clear();
+    }
+    
+    std::uint32_t getState(size_t lane) const {
+        return lanes[lane].state;
+    }
+    
+    /**
+     * Encrypt the next length letters of one lane
+     */
+    void encrypt(size_t laneIndex, const Symbol* input, Symbol* output, size_t length) {
+        Lane& lane = lanes[laneIndex];
+        std::uint32_t current = lane.state;
+        
+        for (size_t i = 0; i < length; i++) {
+            current = engine->nextState(current);
+            output[i] = lane.plugOut[engine->scramblerTable(current)[lane.plugIn[input[i]]]];
+        }
+        
+        lane.state = current;
+    }
+    
+    /**
+     * Encrypt the next length letters of every lane, lane k reading
+     * input[k] and writing output[k]. Lanes are stepped a group at a time,
+     * one letter each in turn, and the table after each lane's next key
+     * press is prefetched, so the cache misses of different keys overlap
+     * instead of queueing. Output is the same as encrypt() lane by lane.
+     */
+    void encryptLanes(const Symbol* const* input, Symbol* const* output, size_t length) {
+        for (size_t first = 0; first < lanes.size(); first += GROUP) {
+            size_t count = std::min(GROUP, lanes.size() - first);
+            std::uint32_t current[GROUP];
+            for (size_t j = 0; j < count; j++) {
+                current[j] = lanes[first + j].state;
+                ENIGMA_PREFETCH(engine->scramblerTable(engine->nextState(current[j])));
+            }
+            
+            for (size_t i = 0; i < length; i++) {
+                for (size_t j = 0; j < count; j++) {
+                    const Lane& lane = lanes[first + j];
+                    current[j] = engine->nextState(current[j]);
+                    ENIGMA_PREFETCH(engine->scramblerTable(engine->nextState(current[j])));
+                    output[first + j][i] = lane.plugOut[engine->scramblerTable(current[j])[lane.plugIn[input[first + j][i]]]];
+                }
+            }
+            
+            for (size_t j = 0; j < count; j++) {
+                lanes[first + j].state = current[j];
+            }
+        }
+    }
+};
+
+template <class Alphabet>
+const size_t BasicEnigmaBatch<Alphabet>::GROUP;
+
+// The historical 26-letter machine
+typedef BasicEnigmaComponent<LatinAlphabet> EnigmaComponent;
+typedef BasicRotor<LatinAlphabet> Rotor;
+typedef BasicReflector<LatinAlphabet> Reflector;
+typedef BasicPlugboard<LatinAlphabet> Plugboard;
+typedef BasicEnigmaMachine<LatinAlphabet> EnigmaMachine;
+typedef BasicCompiledEnigma<LatinAlphabet> CompiledEnigma;
+typedef BasicKeyStream<LatinAlphabet> KeyStream;
+typedef BasicEnigmaBatch<LatinAlphabet> EnigmaBatch;
+
+/**
+ * Streaming UTF-8 front end: validates the input and spells German
+ * umlauts and sharp s the way operators keyed them (AE, OE, UE, SS),
+ * ahead of the cipher. Runs of ASCII are found 16 bytes at a time and
+ * copied whole; only non-ASCII bytes are decoded one sequence at a time.
+ * Other valid characters are passed on unchanged, and a sequence split
+ * between chunks is completed by the next call to feed().
+ */
+class Utf8Transliterator {
+private:
+    unsigned char pending[4];
+    size_t pendingLength;
+    std::uint64_t position;     // bytes fed before the current chunk
+    
+    static size_t asciiRun(const char* data, size_t length) {
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= length; i += 16) {
+            int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+            if (mask) {
+                return i + lowestSetBit(mask);
+            }
+        }
+#endif
+        while (i < length && !(static_cast<unsigned char>(data[i]) & 0x80)) {
+            i++;
+        }
+        return i;
+    }
+    
+    static size_t sequenceLength(unsigned char lead) {
+        return lead >= 0xC2 && lead <= 0xDF ? 2
+             : lead >= 0xE0 && lead <= 0xEF ? 3
+             : lead >= 0xF0 && lead <= 0xF4 ? 4
+             : 0;
+    }
+    
+    // Continuation byte rules, including those that exclude overlong
+    // forms, surrogates and code points past U+10FFFF
+    static bool isContinuation(unsigned char lead, size_t index, unsigned char byte) {
+        if ((byte & 0xC0) != 0x80) return false;
+        if (index != 1) return true;
+        switch (lead) {
+            case 0xE0: return byte >= 0xA0;
+            case 0xED: return byte < 0xA0;
+            case 0xF0: return byte >= 0x90;
+            case 0xF4: return byte < 0x90;
+            default:   return true;
+        }
+    }
+    
+    static const char* spelling(std::uint32_t codePoint) {
+        switch (codePoint) {
+            case 0x00C4: return "AE";
+            case 0x00D6: return "OE";
+            case 0x00DC: return "UE";
+            case 0x00E4: return "ae";
+            case 0x00F6: return "oe";
+            case 0x00FC: return "ue";
+            case 0x00DF: return "ss";
+            case 0x1E9E: return "SS";
+            default:     return nullptr;
+        }
+    }
+    
+    // Decode one sequence at data and append its spelling; returns the
+    // bytes used, or 0 if the sequence continues past the available bytes
+    size_t decode(const unsigned char* data, size_t available, std::uint64_t offset, std::string& out) const {
+        size_t length = sequenceLength(data[0]);
+        for (size_t k = 1; k < length && k < available; k++) {
+            if (!isContinuation(data[0], k, data[k])) {
+                length = 0;
+            }
+        }
+        if (length == 0) {
+            throw std::invalid_argument("Invalid UTF-8 at byte " + std::to_string(offset));
+        }
+        if (available < length) {
+            return 0;
+        }
+        
+        std::uint32_t codePoint = data[0] & (0x7F >> length);
+        for (size_t k = 1; k < length; k++) {
+            codePoint = codePoint << 6 | (data[k] & 0x3F);
+        }
+        const char* replacement = spelling(codePoint);
+        if (replacement) {
+            out += replacement;
+        } else {
+            out.append(reinterpret_cast<const char*>(data), length);
+        }
+        return length;
+    }
+    
+public:
+    Utf8Transliterator() : pendingLength(0), position(0) {}
+    
+    /**
+     * Append the transliteration of the next chunk of input to out
+     */
+    void feed(const char* data, size_t length, std::string& out) {
+        size_t i = 0;
+        
+        // Finish a sequence left open by the previous chunk
+        while (pendingLength > 0 && i < length) {
+            pending[pendingLength++] = static_cast<unsigned char>(data[i++]);
+            if (decode(pending, pendingLength, position - (pendingLength - i), out) > 0) {
+                pendingLength = 0;
+            }
+        }
+        
+        while (i < length) {
+            size_t run = asciiRun(data + i, length - i);
+            out.append(data + i, run);
+            i += run;
+            if (i == length) break;
+            
+            const unsigned char* sequence = reinterpret_cast<const unsigned char*>(data + i);
+            size_t used = decode(sequence, length - i, position + i, out);
+            if (used == 0) {
+                std::copy(sequence, sequence + (length - i), pending);
+                pendingLength = length - i;
+                break;
+            }
+            i += used;
+        }
+        
+        position += length;
+    }
+    
+    /**
+     * Take a chunk that needs no transliteration (all ASCII, no sequence
+     * open) as it stands, so the caller can use it in place; false means
+     * it must go through feed()
+     */
+    bool acceptAscii(const char* data, size_t length) {
+        if (pendingLength > 0 || asciiRun(data, length) != length) {
+            return false;
+        }
+        position += length;
+        return true;
+    }
+    
+    /**
+     * End of input; a sequence still open is an error
+     */
+    void finish() {
+        if (pendingLength > 0) {
+            throw std::invalid_argument("UTF-8 sequence cut off at end of input");
+        }
+    }
+    
+    /**
+     * Transliterate a complete text
+     */
+    static std::string transliterate(const std::string& text) {
+        Utf8Transliterator front;
+        std::string result;
+        result.reserve(text.size());
+        front.feed(text.data(), text.size(), result);
+        front.finish();
+        return result;
+    }
+};
+
+/**
+ * Factory functions to create historical Enigma components
+ */
+namespace EnigmaFactory {
+    // Historical rotor wirings (Commercial Enigma I)
+    Rotor createRotorI(int position = 0, int ringSetting = 0) {
+        Rotor rotor("EKMFLGDQVZNTOWYHXUSPAIBRCJ", 16, "Rotor I");
+        rotor.setPosition(position);
+        rotor.setRingSetting(ringSetting);
+        return rotor;
+    }
+    
+    Rotor createRotorII(int position = 0, int ringSetting = 0) {
+        Rotor rotor("AJDKSIRUXBLHWTMCQGZNPYFVOE", 4, "Rotor II");
+        rotor.setPosition(position);
+        rotor.setRingSetting(ringSetting);
+        return rotor;
+    }
+    
+    Rotor createRotorIII(int position = 0, int ringSetting = 0) {
+        Rotor rotor("BDFHJLCPRTXVZNYEIWGAKMUSQO", 21, "Rotor III");
+        rotor.setPosition(position);
+        rotor.setRingSetting(ringSetting);
+        return rotor;
+    }
+    
+    // Reflector B (most common)
+    Reflector createReflectorB() {
+        return Reflector("YRUHQSLDPXNGOKMIEBFZCWVJAT", "Reflector B");
+    }
+    
+    // Reflector C
+    Reflector createReflectorC() {
+        return Reflector("FVPJIAOYEDRZXWGCTKUQSBNMHL", "Reflector C");
+    }
+    
+    Rotor createRotorIV(int position = 0, int ringSetting = 0) {
+        Rotor rotor("ESOVPZJAYQUIRHXLNFTGKDCMWB", 9, "Rotor IV");
+        rotor.setPosition(position);
+        rotor.setRingSetting(ringSetting);
+        return rotor;
+    }
+    
+    Rotor createRotorV(int position = 0, int ringSetting = 0) {
+        Rotor rotor("VZBRGITYUPSDNHLXAWMJQOFECK", 25, "Rotor V");
+        rotor.setPosition(position);
+        rotor.setRingSetting(ringSetting);
+        return rotor;
+    }
+    
+    // Enigma I rotors by number (1-5)
+    Rotor createRotor(int number, int position = 0, int ringSetting = 0) {
+        switch (number) {
+            case 1: return createRotorI(position, ringSetting);
+            case 2: return createRotorII(position, ringSetting);
+            case 3: return createRotorIII(position, ringSetting);
+            case 4: return createRotorIV(position, ringSetting);
+            case 5: return createRotorV(position, ringSetting);
+            default: throw std::invalid_argument("Rotor number out of range");
+        }
+    }
+    
+    /**
+     * Random plugboard with the given number of cables
+     */
+    template <class Rng>
+    Plugboard createRandomPlugboard(Rng& rng, int pairs = 10) {
+        std::vector<int> letters(ALPHABET_SIZE);
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            letters[i] = i;
+        }
+        std::shuffle(letters.begin(), letters.end(), rng);
+        
+        Plugboard plugboard;
+        for (int i = 0; i < pairs && 2 * i + 1 < ALPHABET_SIZE; i++) {
+            plugboard.connect(indexToChar(letters[2 * i]), indexToChar(letters[2 * i + 1]));
+        }
+        return plugboard;
+    }
+    
+    /**
+     * Random Enigma I key: wheel order from rotors I-V, reflector B or C,
+     * ring settings, start positions and plugboard
+     */
+    template <class Rng>
+    EnigmaMachine createRandomEnigmaI(Rng& rng, int plugPairs = 10) {
+        int order[5] = {1, 2, 3, 4, 5};
+        std::shuffle(order, order + 5, rng);
+        std::uniform_int_distribution<int> letter(0, ALPHABET_SIZE - 1);
+        
+        std::vector<Rotor> rotors;
+        for (int i = 0; i < 3; i++) {
+            rotors.push_back(createRotor(order[i], letter(rng), letter(rng)));
+        }
+        
+        EnigmaMachine machine(rotors, letter(rng) % 2 ? createReflectorB() : createReflectorC());
+        machine.setPlugboard(createRandomPlugboard(rng, plugPairs));
+        return machine;
+    }
+    
+    // Reflector D (UKW-D), rewired in the field to the given wiring
+    Reflector createReflectorD(const std::string& wiring) {
+        return Reflector(wiring, "Reflector D");
+    }
+    
+    // Reflector D from its 13 plugged pairs
+    Reflector createReflectorD(const std::vector<std::pair<char, char>>& pairs) {
+        return Reflector(pairs, "Reflector D");
+    }
+    
+    /**
+     * Wheel with any number of notches, given as letters
+     */
+    Rotor createWheel(const std::string& wiring, const std::string& notches, const std::string& name,
+                      int position = 0, int ringSetting = 0) {
+        Rotor rotor(wiring, 0, name);
+        rotor.clearNotches();
+        for (char notch : notches) {
+            rotor.addNotch(charToIndex(notch));
+        }
+        rotor.setPosition(position);
+        rotor.setRingSetting(ringSetting);
+        return rotor;
+    }
+    
+    /**
+     * Entry wheel (Eintrittswalze); contactOrder lists the keys wired to
+     * contacts A, B, C, ... (Enigma I uses the identity and needs none)
+     */
+    Rotor createEntryWheel(const std::string& contactOrder, const std::string& name = "Entry Wheel") {
+        std::string wiring(ALPHABET_SIZE, FIRST_LETTER);
+        for (int i = 0; i < ALPHABET_SIZE && i < static_cast<int>(contactOrder.size()); i++) {
+            wiring[charToIndex(contactOrder[i])] = indexToChar(i);
+        }
+        Rotor entry(wiring, 0, name);
+        entry.clearNotches();
+        return entry;
+    }
+    
+    /**
+     * Wiring tables for the variant machines, from published tables. The
+     * machines built from them step by this simulator's model (see
+     * SteppingMode), so their traffic is not that of the real machines.
+     */
+    struct WheelSpec {
+        const char* wiring;
+        const char* notches;
+        const char* name;
+    };
+    
+    const char* const ENTRY_QWERTZU = "QWERTZUIOASDFGHJKPYXCVBNML";
+    const char* const ENTRY_TIRPITZ = "KZROUQHYAIGBLWVSTDXFPNMCJE";
+    
+    const WheelSpec ROTORS_K[] = {
+        {"PEZUOHXSCVFMTBGLRINQJWAYDK", "Y", "Rotor I-K"},
+        {"ZOUESYDKFWPCIQXHMVBLGNJRAT", "E", "Rotor II-K"},
+        {"EHRVXGAOBQUSIMZFLYNWKTPDJC", "N", "Rotor III-K"}
+    };
+    
+    const WheelSpec ROTORS_D[] = {
+        {"LPGSZMHAEOQKVXRFYBUTNICJDW", "Y", "Rotor I-D"},
+        {"SLVGBTFXJQOHEWIRZYAMKPCNDU", "E", "Rotor II-D"},
+        {"CJGDPSHKTURAWZXFMYNQOBVLEI", "N", "Rotor III-D"}
+    };
+    
+    const WheelSpec ROTORS_RAILWAY[] = {
+        {"JGDQOXUSCAMIFRVTPNEWKBLZYH", "N", "Rotor I-R"},
+        {"NTZPSFBOKMWRCJDIVLAEYUXHGQ", "E", "Rotor II-R"},
+        {"JVIUBHTCDYAKEQZPOSGXNRMWFL", "Y", "Rotor III-R"}
+    };
+    
+    const WheelSpec ROTORS_G[] = {
+        {"DMTWSILRUYQNKFEJCAZBPGXOHV", "SUVWZABCEFGIKLOPQ", "Rotor I-G"},
+        {"HQZGPJTMOBLNCIFDYAWVEUSRKX", "STVYZACDFGHKMNQ", "Rotor II-G"},
+        {"UQNTLSZFMREHDPXKIBVYGJCWOA", "UWXAEFHKMNR", "Rotor III-G"}
+    };
+    
+    const WheelSpec ROTORS_T[] = {
+        {"KPTYUELOCVGRFQDANJMBSWHZXI", "WZEKQ", "Rotor I-T"},
+        {"UPHZLWEQMTDJXCAKSOIGVBYFNR", "WZFLR", "Rotor II-T"},
+        {"QUDLYRFEKONVZAXWHMGPJBSICT", "WZEKQ", "Rotor III-T"},
+        {"CIWTBKXNRESPFLYDAGVHQUOJZM", "WZFLR", "Rotor IV-T"},
+        {"UAXGISNJBVERDYLFZWTPCKOHMQ", "YCFKR", "Rotor V-T"},
+        {"XFUZGALVHCNYSEWQTDMRBKPIOJ", "XEIMQ", "Rotor VI-T"},
+        {"BJVFTXPLNAYOZIKWGDQERUCHSM", "YCFKR", "Rotor VII-T"},
+        {"YMTPNZHWKODAJXELUQVGCBISFR", "XEIMQ", "Rotor VIII-T"}
+    };
+    
+    // Typex wheel wirings were never published. These are not Typex
+    // wheels: A is invented, B-E reuse the wirings of Enigma II-V, the
+    // notches are invented and the Typex reflector is reflector B
+    const WheelSpec ROTORS_TYPEX[] = {
+        {"QWECYJIBFKMLTVZPOHUDGNRSXA", "WXBGN", "Typex A"},
+        {"AJDKSIRUXBLHWTMCQGZNPYFVOE", "WXBHO", "Typex B"},
+        {"BDFHJLCPRTXVZNYEIWGAKMUSQO", "WXBIP", "Typex C"},
+        {"ESOVPZJAYQUIRHXLNFTGKDCMWB", "WXBJQ", "Typex D"},
+        {"VZBRGITYUPSDNHLXAWMJQOFECK", "WXBKR", "Typex E"}
+    };
+    
+    template <size_t Count>
+    Rotor createVariantRotor(const WheelSpec (&specs)[Count], int number, int position, int ringSetting) {
+        if (number < 1 || number > static_cast<int>(Count)) {
+            throw std::invalid_argument("Rotor number out of range");
+        }
+        const WheelSpec& spec = specs[number - 1];
+        return createWheel(spec.wiring, spec.notches, spec.name, position, ringSetting);
+    }
+    
+    Rotor createRotorK(int number, int position = 0, int ringSetting = 0) {
+        return createVariantRotor(ROTORS_K, number, position, ringSetting);
+    }
+    
+    Rotor createRotorD(int number, int position = 0, int ringSetting = 0) {
+        return createVariantRotor(ROTORS_D, number, position, ringSetting);
+    }
+    
+    Rotor createRotorRailway(int number, int position = 0, int ringSetting = 0) {
+        return createVariantRotor(ROTORS_RAILWAY, number, position, ringSetting);
+    }
+    
+    Rotor createRotorG(int number, int position = 0, int ringSetting = 0) {
+        return createVariantRotor(ROTORS_G, number, position, ringSetting);
+    }
+    
+    Rotor createRotorT(int number, int position = 0, int ringSetting = 0) {
+        return createVariantRotor(ROTORS_T, number, position, ringSetting);
+    }
+    
+    // Typex wheels are lettered A-E
+    Rotor createTypexRotor(char wheel, int position = 0, int ringSetting = 0) {
+        return createVariantRotor(ROTORS_TYPEX, toAsciiUpper(wheel) - 'A' + 1, position, ringSetting);
+    }
+    
+    /**
+     * Complete variant machines, wheels given left to right
+     */
+    EnigmaMachine createEnigmaK(int left = 1, int middle = 2, int right = 3) {
+        EnigmaMachine machine({createRotorK(left), createRotorK(middle), createRotorK(right)},
+                              Reflector("IMETCGFRAYSQBZXWLHKDVUPOJN", "Reflector K"));
+        machine.setStators({createEntryWheel(ENTRY_QWERTZU)});
+        return machine;
+    }
+    
+    EnigmaMachine createEnigmaD(int left = 1, int middle = 2, int right = 3) {
+        EnigmaMachine machine({createRotorD(left), createRotorD(middle), createRotorD(right)},
+                              Reflector("IMETCGFRAYSQBZXWLHKDVUPOJN", "Reflector D-Commercial"));
+        machine.setStators({createEntryWheel(ENTRY_QWERTZU)});
+        return machine;
+    }
+    
+    EnigmaMachine createRailwayEnigma(int left = 1, int middle = 2, int right = 3) {
+        EnigmaMachine machine({createRotorRailway(left), createRotorRailway(middle), createRotorRailway(right)},
+                              Reflector("QYHOGNECVPUZTFDJAXWMKISRBL", "Reflector Railway"));
+        machine.setStators({createEntryWheel(ENTRY_QWERTZU)});
+        return machine;
+    }
+    
+    // Enigma G: cog-wheel stepping, the reflector turns with the wheels
+    EnigmaMachine createEnigmaG(int left = 1, int middle = 2, int right = 3) {
+        EnigmaMachine machine({createRotorG(left), createRotorG(middle), createRotorG(right)},
+                              Reflector("RULQMZJSYGOCETKWDAHNBXPVIF", "Reflector G"));
+        machine.setStators({createEntryWheel(ENTRY_QWERTZU)});
+        machine.setSteppingMode(SteppingMode::CogWheel);
+        return machine;
+    }
+    
+    EnigmaMachine createEnigmaT(int left = 1, int middle = 2, int right = 3) {
+        EnigmaMachine machine({createRotorT(left), createRotorT(middle), createRotorT(right)},
+                              Reflector("GEKPBTAUMOCNILJDXZYFHWVQSR", "Reflector T"));
+        machine.setStators({createEntryWheel(ENTRY_TIRPITZ)});
+        return machine;
+    }
+    
+    // Typex: five wheels, the two on the right are stators (illustrative
+    // wirings only, see ROTORS_TYPEX)
+    EnigmaMachine createTypex(const std::string& wheelOrder = "ABCDE") {
+        if (wheelOrder.size() != 5) {
+            throw std::invalid_argument("Typex requires exactly 5 wheels");
+        }
+        EnigmaMachine machine({createTypexRotor(wheelOrder[0]), createTypexRotor(wheelOrder[1]),
+                               createTypexRotor(wheelOrder[2])},
+                              Reflector("YRUHQSLDPXNGOKMIEBFZCWVJAT", "Typex Reflector"));
+        machine.setStators({createTypexRotor(wheelOrder[3]), createTypexRotor(wheelOrder[4])});
+        return machine;
+    }
+}
+
+/**
+ * Uhr box - a rotary switch between ten plugboard cables that turns the
+ * reciprocal steckering into a non-reciprocal mapping. The 'a' plug of
+ * cable j goes into the socket of pair.first, the 'b' plug into the socket
+ * of pair.second. All 40 dial settings are compiled to flat plugboard
+ * tables up front, so switching settings costs nothing per letter.
+ */
+class UhrBox {
+public:
+    static const int CABLES = 10;
+    static const int SETTINGS = 40;
+    
+private:
+    // Disc wiring: 'a'-side contact -> 'b'-side contact. Each plug has a
+    // large pin at contact 4j and a small pin at contact 4j + 2.
+    static const int DISC[SETTINGS];
+    
+    std::vector<std::pair<char, char>> cables;
+    std::vector<Plugboard> settings;
+    
+public:
+    explicit UhrBox(const std::vector<std::pair<char, char>>& pairs)
+        : cables(pairs) {
+        if (cables.size() != static_cast<size_t>(CABLES)) {
+            throw std::invalid_argument("Uhr box requires exactly 10 cables");
+        }
+        
+        // Reject letters used twice by building the equivalent cabling
+        Plugboard check;
+        for (const auto& cable : cables) {
+            check.connect(cable.first, cable.second);
+        }
+        
+        int reverseDisc[SETTINGS];
+        for (int contact = 0; contact < SETTINGS; contact++) {
+            reverseDisc[DISC[contact]] = contact;
+        }
+        
+        for (int dial = 0; dial < SETTINGS; dial++) {
+            std::string mapping;
+            for (int i = 0; i < ALPHABET_SIZE; i++) {
+                mapping += indexToChar(i);
+            }
+            
+            for (int j = 0; j < CABLES; j++) {
+                // Large pin of plug j through the disc to a small pin
+                int fromA = (DISC[(4 * j + dial) % SETTINGS] - dial + SETTINGS) % SETTINGS;
+                int fromB = (reverseDisc[(4 * j + dial) % SETTINGS] - dial + SETTINGS) % SETTINGS;
+                
+                mapping[charToIndex(cables[j].first)] = LatinAlphabet::normalize(cables[fromA / 4].second);
+                mapping[charToIndex(cables[j].second)] = LatinAlphabet::normalize(cables[fromB / 4].first);
+            }
+            
+            Plugboard plugboard;
+            plugboard.setPermutation(mapping);
+            settings.push_back(plugboard);
+        }
+    }
+    
+    /**
+     * Precompiled plugboard for a dial setting (0-39)
+     */
+    const Plugboard& getPlugboard(int setting) const {
+        return settings[AlphabetModulus<SETTINGS>::normalize(setting)];
+    }
+    
+    const std::vector<std::pair<char, char>>& getCables() const {
+        return cables;
+    }
+};
+
+const int UhrBox::DISC[UhrBox::SETTINGS] = {
+    6, 31, 4, 29, 18, 39, 16, 25, 30, 23, 28, 1, 38, 11, 36, 37, 26, 27, 24, 21,
+    14, 3, 12, 17, 2, 7, 0, 33, 10, 35, 8, 5, 22, 19, 20, 13, 34, 15, 32, 9
+};
+
+/**
+ * All 60 orders of wheels I-V, left to right
+ */
+std::vector<std::array<int, 3>> allWheelOrders() {
+    std::vector<std::array<int, 3>> orders;
+    for (int l = 1; l <= 5; l++) {
+        for (int m = 1; m <= 5; m++) {
+            for (int r = 1; r <= 5; r++) {
+                if (l != m && m != r && l != r) {
+                    orders.push_back({{l, m, r}});
+                }
+            }
+        }
+    }
+    return orders;
+}
+
+/**
+ * Number of worker threads for the parallel analysis engines
+ */
+unsigned defaultWorkerCount() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+/**
+ * Bind the calling thread to a set of CPUs. Returns false where thread
+ * affinity is not supported.
+ */
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+/**
+ * NUMA layout: the CPUs of each memory node that this process may run
+ * on, read from sysfs on Linux. Elsewhere, or without sysfs, there is one
+ * node holding every CPU the process may run on. Workers are dealt out to
+ * CPUs alternating between nodes, so a partial worker count still uses
+ * every node's memory bandwidth. Workers are only bound to those CPUs
+ * once pinning is enabled (--numa, --bench-numa); by default threads are
+ * left to the scheduler.
+ */
+class NumaTopology {
+private:
+    std::vector<std::vector<int>> nodeCpus;
+    std::vector<int> workerCpus;
+    std::vector<int> workerNodes;
+    
+    // Parse a sysfs list such as "0-3,8-11"
+    static std::vector<int> parseList(const std::string& list) {
+        std::vector<int> values;
+        std::stringstream stream(list);
+        std::string range;
+        
+        while (std::getline(stream, range, ',')) {
+            if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0]))) continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int value = first; value <= last; value++) {
+                values.push_back(value);
+            }
+        }
+        
+        return values;
+    }
+    
+    static std::string readLine(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+    
+    static std::atomic<bool>& pinningFlag() {
+        static std::atomic<bool> enabled(false);
+        return enabled;
+    }
+    
+    NumaTopology() {
+#ifdef __linux__
+        cpu_set_t allowed;
+        bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        
+        for (int node : parseList(readLine("/sys/devices/system/node/online"))) {
+            std::vector<int> cpus;
+            for (int cpu : parseList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))) {
+                if (!haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (!cpus.empty()) {
+                nodeCpus.push_back(cpus);
+            }
+        }
+        if (nodeCpus.empty() && haveMask) {
+            nodeCpus.push_back(std::vector<int>());
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    nodeCpus[0].push_back(cpu);
+                }
+            }
+        }
+#endif
+        if (nodeCpus.empty()) {
+            nodeCpus.push_back(std::vector<int>());
+            for (unsigned cpu = 0; cpu < defaultWorkerCount(); cpu++) {
+                nodeCpus[0].push_back(cpu);
+            }
+        }
+        
+        for (size_t round = 0; workerCpus.size() < countCpus(); round++) {
+            for (size_t node = 0; node < nodeCpus.size(); node++) {
+                if (round < nodeCpus[node].size()) {
+                    workerCpus.push_back(nodeCpus[node][round]);
+                    workerNodes.push_back(node);
+                }
+            }
+        }
+    }
+    
+    size_t countCpus() const {
+        size_t count = 0;
+        for (const auto& cpus : nodeCpus) {
+            count += cpus.size();
+        }
+        return count;
+    }
+    
+public:
+    static const NumaTopology& get() {
+        static const NumaTopology topology;
+        return topology;
+    }
+    
+    /**
+     * Bind runWorkers threads to CPUs from now on. Binding stays within
+     * the affinity mask the process started with.
+     */
+    static void enablePinning() {
+        pinningFlag() = true;
+    }
+    
+    static bool isPinning() {
+        return pinningFlag();
+    }
+    
+    size_t getNodeCount() const {
+        return nodeCpus.size();
+    }
+    
+    const std::vector<int>& getCpus(size_t node) const {
+        return nodeCpus[node];
+    }
+    
+    int cpuOfWorker(unsigned worker) const {
+        return workerCpus[worker % workerCpus.size()];
+    }
+    
+    size_t nodeOfWorker(unsigned worker) const {
+        return workerNodes[worker % workerNodes.size()];
+    }
+};
+
+/**
+ * Run body(worker) on the given number of threads and wait for all of
+ * them. With pinning enabled each thread is bound to its own CPU (see
+ * NumaTopology), so memory it allocates itself stays on its node.
+ */
+void runWorkers(unsigned workers, const std::function<void(unsigned)>& body) {
+    if (workers <= 1) {
+        body(0);
+        return;
+    }
+    
+    std::vector<std::thread> threads;
+    for (unsigned worker = 0; worker < workers; worker++) {
+        threads.push_back(std::thread([&body, worker]() {
+            if (NumaTopology::isPinning()) {
+                pinCurrentThread(std::vector<int>(1, NumaTopology::get().cpuOfWorker(worker)));
+            }
+            body(worker);
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * Read-only data copied once per NUMA node. Each copy is made by a
+ * thread bound to its node, so first-touch placement puts its pages in
+ * that node's memory, and pinned runWorkers threads read the copy on
+ * their own node. On a single node, or without pinning (when workers may
+ * run anywhere), the original is used directly.
+ */
+template <class T>
+class NodeReplicas {
+private:
+    const T* source;
+    std::vector<std::unique_ptr<T>> copies;
+    
+public:
+    explicit NodeReplicas(const T& source) : source(&source) {
+        const NumaTopology& topology = NumaTopology::get();
+        if (topology.getNodeCount() <= 1 || !NumaTopology::isPinning()) return;
+        
+        copies.resize(topology.getNodeCount());
+        std::vector<std::thread> threads;
+        for (size_t node = 0; node < copies.size(); node++) {
+            threads.push_back(std::thread([this, &topology, node]() {
+                pinCurrentThread(topology.getCpus(node));
+                copies[node].reset(new T(*this->source));
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    const T& forNode(size_t node) const {
+        return copies.empty() ? *source : *copies[node];
+    }
+    
+    const T& forWorker(unsigned worker) const {
+        return forNode(NumaTopology::get().nodeOfWorker(worker));
+    }
+};
+
+/**
+ * Scrambler tables for all 60 orders of wheels I-V under one reflector
+ * and ring setting (about 27 MB), in one block on huge pages where the
+ * system allows. Each order keeps its compiled engine's stepping-order
+ * layout, so a message walks the tables front to back: the table for the
+ * next key press is the next N bytes except at the end of a stepping
+ * cycle. Orders are built in parallel.
+ */
+class ScramblerTableSet {
+private:
+    std::vector<std::array<int, 3>> wheels;
+    std::uint32_t statesPerOrder;
+    TableStorage<std::uint8_t> tables;      // order, then state, then signal
+    std::vector<std::uint32_t> nextStates;
+    std::vector<std::uint32_t> stateOfPositions;
+    
+public:
+    ScramblerTableSet(const Reflector& reflector, int leftRing = 0, int middleRing = 0, int rightRing = 0,
+                      bool hugePages = true, unsigned workers = defaultWorkerCount())
+        : wheels(allWheelOrders()), statesPerOrder(ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE) {
+        size_t total = wheels.size() * static_cast<size_t>(statesPerOrder);
+        tables = TableStorage<std::uint8_t>(total * ALPHABET_SIZE, hugePages);
+        nextStates.resize(total);
+        stateOfPositions.resize(total);
+        std::atomic<size_t> nextOrder(0);
+        
+        runWorkers(workers, [&](unsigned) {
+            for (;;) {
+                size_t order = nextOrder.fetch_add(1);
+                if (order >= wheels.size()) break;
+                
+                std::vector<Rotor> rotors = {
+                    EnigmaFactory::createRotor(wheels[order][0], 0, leftRing),
+                    EnigmaFactory::createRotor(wheels[order][1], 0, middleRing),
+                    EnigmaFactory::createRotor(wheels[order][2], 0, rightRing)
+                };
+                CompiledEnigma engine(EnigmaMachine(rotors, reflector));
+                
+                size_t base = order * statesPerOrder;
+                for (std::uint32_t state = 0; state < statesPerOrder; state++) {
+                    nextStates[base + state] = engine.nextState(state);
+                    stateOfPositions[base + state] = engine.stateOfPositionalIndex(state);
+                    std::copy(engine.scramblerTable(state), engine.scramblerTable(state) + ALPHABET_SIZE,
+                              &tables[(base + state) * ALPHABET_SIZE]);
+                }
+            }
+        });
+    }
+    
+    size_t getOrderCount() const {
+        return wheels.size();
+    }
+    
+    /**
+     * Wheel numbers (1-5), left to right, of an order
+     */
+    const std::array<int, 3>& getWheels(size_t order) const {
+        return wheels[order];
+    }
+    
+    std::uint32_t getStatesPerOrder() const {
+        return statesPerOrder;
+    }
+    
+    PageBacking getBacking() const {
+        return tables.getBacking();
+    }
+    
+    /**
+     * State of an order for a set of wheel positions
+     */
+    std::uint32_t stateIndex(size_t order, int left, int middle, int right) const {
+        std::uint32_t index = (left * ALPHABET_SIZE + middle) * ALPHABET_SIZE + right;
+        return stateOfPositions[order * statesPerOrder + index];
+    }
+    
+    std::uint32_t nextState(size_t order, std::uint32_t state) const {
+        return nextStates[order * statesPerOrder + state];
+    }
+    
+    const std::uint8_t* table(size_t order, std::uint32_t state) const {
+        return &tables[(order * statesPerOrder + state) * ALPHABET_SIZE];
+    }
+};
+
+/**
+ * Precompute service for wheel-order tables. Requested orders of wheels
+ * I-V are loaded from a cache directory when a matching file is there and
+ * compiled in parallel otherwise, then written back. Files are keyed by
+ * wheel numbers plus a hash over the table format version, the wheel and
+ * reflector wirings and notches, and the ring settings, so a file made
+ * for any other configuration is never reused. Loaded tables are mapped
+ * straight from the file.
+ */
+class WheelOrderCache {
+private:
+    static const std::uint32_t VERSION = 1;
+    
+    std::string directory;
+    Reflector reflector;
+    int rings[3];
+    std::atomic<unsigned> loaded;
+    std::atomic<unsigned> built;
+    
+    static void hash(std::uint64_t& h, const std::string& bytes) {
+        for (unsigned char c : bytes) {
+            h = (h ^ c) * 1099511628211ULL;
+        }
+    }
+    
+    std::uint64_t keyFor(const std::array<int, 3>& wheels) const {
+        std::uint64_t h = 14695981039346656037ULL;
+        hash(h, "v" + std::to_string(VERSION) + ";" + reflector.getWiring() + ";");
+        for (int i = 0; i < 3; i++) {
+            Rotor rotor = EnigmaFactory::createRotor(wheels[i]);
+            hash(h, rotor.getWiring() + ";" + std::to_string(rotor.getNotchMask()) + ";" + std::to_string(rings[i]) + ";");
+        }
+        return h;
+    }
+    
+    std::string pathFor(const std::array<int, 3>& wheels, std::uint64_t key) const {
+        std::stringstream name;
+        name << directory << "/enigma-tables-v" << VERSION << "-" << wheels[0] << wheels[1] << wheels[2]
+             << "-" << std::hex << key << ".bin";
+        return name.str();
+    }
+    
+public:
+    /**
+     * The directory is created if missing (where supported)
+     */
+    WheelOrderCache(const std::string& directory, const Reflector& reflector,
+                    int leftRing = 0, int middleRing = 0, int rightRing = 0)
+        : directory(directory), reflector(reflector), loaded(0), built(0) {
+        rings[0] = leftRing;
+        rings[1] = middleRing;
+        rings[2] = rightRing;
+#ifdef __linux__
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+    
+    /**
+     * Engines for the requested wheel orders, in request order
+     */
+    std::vector<std::unique_ptr<CompiledEnigma>> get(const std::vector<std::array<int, 3>>& orders,
+                                                     unsigned workers = defaultWorkerCount()) {
+        std::vector<std::unique_ptr<CompiledEnigma>> engines(orders.size());
+        std::atomic<size_t> nextOrder(0);
+        
+        runWorkers(workers, [&](unsigned) {
+            for (;;) {
+                size_t order = nextOrder.fetch_add(1);
+                if (order >= orders.size()) break;
+                
+                std::uint64_t key = keyFor(orders[order]);
+                std::string path = pathFor(orders[order], key);
+                try {
+                    engines[order].reset(new CompiledEnigma(path, key));
+                    loaded++;
+                    continue;
+                } catch (const std::exception&) {
+                    // Missing or stale: compile below
+                }
+                
+                std::vector<Rotor> rotors;
+                for (int i = 0; i < 3; i++) {
+                    rotors.push_back(EnigmaFactory::createRotor(orders[order][i], 0, rings[i]));
+                }
+                engines[order].reset(new CompiledEnigma(EnigmaMachine(rotors, reflector)));
+                built++;
+                try {
+                    engines[order]->save(path, key);
+                } catch (const std::exception&) {
+                    // The cache is an optimization; an unwritable directory only costs time
+                }
+            }
+        });
+        
+        return engines;
+    }
+    
+    unsigned getLoadedCount() const {
+        return loaded;
+    }
+    
+    unsigned getBuiltCount() const {
+        return built;
+    }
+};
+
+/**
+ * Count positions where two letter buffers hold the same byte, 32 or 16
+ * bytes per compare where the target supports it
+ */
+size_t countCoincidences(const std::uint8_t* a, const std::uint8_t* b, size_t length) {
+    size_t count = 0;
+    size_t i = 0;
+    
+#ifdef __AVX2__
+    for (; i + 32 <= length; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        count += setBitCount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))));
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        count += setBitCount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+    }
+#endif
+    for (; i < length; i++) {
+        count += a[i] == b[i];
+    }
+    
+    return count;
+}
+
+/**
+ * True if two letter buffers hold the same byte anywhere; stops at the
+ * first 16-byte block with a match
+ */
+bool hasCoincidence(const std::uint8_t* a, const std::uint8_t* b, size_t length) {
+    size_t i = 0;
+    
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) {
+            return true;
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (a[i] == b[i]) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/**
+ * Letter histogram for bulk counting. Consecutive letters go to four
+ * interleaved sub-histograms, so runs of one letter do not serialize on a
+ * single counter; they are merged on every add.
+ */
+class LetterHistogram {
+private:
+    std::uint64_t counts[ALPHABET_SIZE];
+    
+public:
+    LetterHistogram() {
+        clear();
+    }
+    
+    void clear() {
+        std::fill(counts, counts + ALPHABET_SIZE, 0);
+    }
+    
+    void add(const std::uint8_t* letters, size_t length) {
+        std::uint32_t sub[4][ALPHABET_SIZE] = {{0}};
+        size_t i = 0;
+        
+        for (; i + 4 <= length; i += 4) {
+            sub[0][letters[i]]++;
+            sub[1][letters[i + 1]]++;
+            sub[2][letters[i + 2]]++;
+            sub[3][letters[i + 3]]++;
+        }
+        for (; i < length; i++) {
+            sub[0][letters[i]]++;
+        }
+        
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            counts[letter] += static_cast<std::uint64_t>(sub[0][letter]) + sub[1][letter] + sub[2][letter] + sub[3][letter];
+        }
+    }
+    
+    void merge(const LetterHistogram& other) {
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            counts[letter] += other.counts[letter];
+        }
+    }
+    
+    std::uint64_t count(int letter) const {
+        return counts[letter];
+    }
+    
+    std::uint64_t total() const {
+        std::uint64_t sum = 0;
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            sum += counts[letter];
+        }
+        return sum;
+    }
+    
+    double indexOfCoincidence() const {
+        double n = static_cast<double>(total());
+        double sum = 0;
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            sum += static_cast<double>(counts[letter]) * (static_cast<double>(counts[letter]) - 1);
+        }
+        return n > 1 ? sum / (n * (n - 1)) : 0.0;
+    }
+    
+    /**
+     * Chi-square statistic against a flat distribution (25 degrees of freedom)
+     */
+    double chiSquare() const {
+        double expected = static_cast<double>(total()) / ALPHABET_SIZE;
+        double sum = 0;
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            double difference = counts[letter] - expected;
+            sum += expected > 0 ? difference * difference / expected : 0.0;
+        }
+        return sum;
+    }
+};
+
+// Longest text whose 16-bit sub-histograms cannot overflow
+const size_t IOC_KERNEL_MAX_LENGTH = 32767;
+
+/**
+ * Sum of n(n-1) over 32 padded 16-bit bins whose total is at most 32767
+ */
+inline std::uint64_t coincidencePairs(const std::uint16_t* bins) {
+#ifdef __SSE2__
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < 32; i += 8) {
+        __m128i counts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bins + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(counts, _mm_sub_epi16(counts, one)));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<std::uint32_t>(_mm_cvtsi128_si32(sum));
+#else
+    std::uint64_t sum = 0;
+    for (int i = 0; i < 32; i++) {
+        sum += static_cast<std::uint64_t>(bins[i]) * (bins[i] - (bins[i] > 0));
+    }
+    return sum;
+#endif
+}
+
+/**
+ * Index-of-coincidence kernel for scoring trial decryptions. The letter
+ * produced by decrypt(i) is counted straight into one of four interleaved
+ * 16-bit sub-histograms (so equal neighbouring letters never wait on the
+ * same counter) and the candidate plaintext is never stored. Sub-histograms
+ * are padded to 32 bins so merging and the sum of n(n-1) vectorize.
+ * decrypt is called for i = 0, 1, 2, ... in order, so it may step a machine.
+ * Texts longer than IOC_KERNEL_MAX_LENGTH are counted in wide counters.
+ */
+template <class Decrypt>
+double fusedIndexOfCoincidence(size_t length, Decrypt decrypt) {
+    if (length < 2) {
+        return 0.0;
+    }
+    
+    if (length > IOC_KERNEL_MAX_LENGTH) {
+        // Long texts: plain 32-bit counting
+        std::uint64_t counts[ALPHABET_SIZE] = {0};
+        for (size_t i = 0; i < length; i++) {
+            counts[decrypt(i)]++;
+        }
+        double sum = 0;
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            sum += static_cast<double>(counts[letter]) * (static_cast<double>(counts[letter]) - 1);
+        }
+        return sum / (static_cast<double>(length) * (length - 1));
+    }
+    
+    std::uint16_t sub[4][32] = {{0}};
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        sub[0][decrypt(i)]++;
+        sub[1][decrypt(i + 1)]++;
+        sub[2][decrypt(i + 2)]++;
+        sub[3][decrypt(i + 3)]++;
+    }
+    for (; i < length; i++) {
+        sub[0][decrypt(i)]++;
+    }
+    
+    std::uint16_t bins[32];
+    for (int bin = 0; bin < 32; bin++) {
+        bins[bin] = static_cast<std::uint16_t>(sub[0][bin] + sub[1][bin] + sub[2][bin] + sub[3][bin]);
+    }
+    
+    return static_cast<double>(coincidencePairs(bins)) / (static_cast<double>(length) * (length - 1));
+}
+
+/**
+ * Decrypt length letters (alphabet indices) from a start state with the
+ * engine's plugboard and return the plaintext's index of coincidence
+ */
+double decryptIndexOfCoincidence(const CompiledEnigma& engine, std::uint32_t startState,
+                                 const std::uint8_t* cipher, size_t length) {
+    const std::uint8_t* plugIn = engine.plugTable(true);
+    const std::uint8_t* plugOut = engine.plugTable(false);
+    
+    std::uint32_t state = startState;
+    return fusedIndexOfCoincidence(length, [&](size_t i) {
+        state = engine.nextState(state);
+        return plugOut[engine.scramblerTable(state)[plugIn[cipher[i]]]];
+    });
+}
+
+/**
+ * Plaintext language model scored as additive log-probabilities, one
+ * table lookup per letter. Row ALPHABET_SIZE holds the scores used for
+ * the first letter; a unigram model fills every row the same.
+ */
+class LanguageModel {
+private:
+    float table[ALPHABET_SIZE + 1][ALPHABET_SIZE];
+    float bestStep;
+    
+    void updateBestStep() {
+        bestStep = table[0][0];
+        for (int prev = 0; prev <= ALPHABET_SIZE; prev++) {
+            for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+                bestStep = std::max(bestStep, table[prev][letter]);
+            }
+        }
+    }
+    
+    LanguageModel() : bestStep(0) {}
+    
+public:
+    /**
+     * German letter frequencies (percent, A-Z)
+     */
+    static LanguageModel german() {
+        static const double FREQUENCIES[ALPHABET_SIZE] = {
+            6.51, 1.89, 3.06, 5.08, 17.40, 1.66, 3.01, 4.76, 7.55, 0.27, 1.21, 3.44, 2.53,
+            9.78, 2.51, 0.79, 0.02, 7.00, 7.27, 6.15, 4.35, 0.67, 1.89, 0.03, 0.04, 1.13
+        };
+        
+        LanguageModel model;
+        for (int prev = 0; prev <= ALPHABET_SIZE; prev++) {
+            for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+                model.table[prev][letter] = static_cast<float>(std::log(FREQUENCIES[letter] / 100.0));
+            }
+        }
+        model.updateBestStep();
+        return model;
+    }
+    
+    /**
+     * Bigram model trained on sample plaintext (add-one smoothing)
+     */
+    static LanguageModel fromCorpus(const std::string& corpus) {
+        double counts[ALPHABET_SIZE + 1][ALPHABET_SIZE];
+        std::fill(&counts[0][0], &counts[0][0] + (ALPHABET_SIZE + 1) * ALPHABET_SIZE, 1.0);
+        
+        int prev = -1;
+        for (char c : corpus) {
+            if (!isAsciiLetter(c)) continue;
+            int letter = charToIndex(c);
+            counts[ALPHABET_SIZE][letter] += 1.0;
+            if (prev >= 0) {
+                counts[prev][letter] += 1.0;
+            }
+            prev = letter;
+        }
+        
+        LanguageModel model;
+        for (int row = 0; row <= ALPHABET_SIZE; row++) {
+            double total = 0;
+            for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+                total += counts[row][letter];
+            }
+            for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+                model.table[row][letter] = static_cast<float>(std::log(counts[row][letter] / total));
+            }
+        }
+        model.updateBestStep();
+        return model;
+    }
+    
+    /**
+     * Score of letter following prev (ALPHABET_SIZE for the first letter)
+     */
+    float step(int prev, int letter) const {
+        return table[prev][letter];
+    }
+    
+    /**
+     * Upper bound on any single step, used to bound unscored remainders
+     */
+    float getBestStep() const {
+        return bestStep;
+    }
+    
+    /**
+     * Average step over text that follows the model's letter frequencies
+     */
+    double getExpectedStep() const {
+        double expected = 0;
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            expected += std::exp(table[ALPHABET_SIZE][letter]) * table[ALPHABET_SIZE][letter];
+        }
+        return expected;
+    }
+    
+    /**
+     * Average step over uniformly random letters, i.e. text decrypted
+     * with the wrong key
+     */
+    double getRandomStep() const {
+        double total = 0;
+        for (int prev = 0; prev < ALPHABET_SIZE; prev++) {
+            for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+                total += table[prev][letter];
+            }
+        }
+        return total / (ALPHABET_SIZE * ALPHABET_SIZE);
+    }
+    
+    double score(const std::string& text) const {
+        double total = 0;
+        int prev = ALPHABET_SIZE;
+        for (char c : text) {
+            if (!isAsciiLetter(c)) continue;
+            int letter = charToIndex(c);
+            total += table[prev][letter];
+            prev = letter;
+        }
+        return total;
+    }
+};
+
+/**
+ * A start state and its plaintext score
+ */
+struct ScoredCandidate {
+    std::uint32_t state;
+    double score;
+};
+
+/**
+ * Fused decrypt-and-score pipeline stage. Each candidate start state is
+ * decrypted with the compiled engine's stepping and tables (the semantics
+ * of EnigmaMachine::encryptChar) and scored in the same loop; every few
+ * letters the partial score plus the best possible score of the rest is
+ * checked against the threshold, and hopeless candidates stop there. No
+ * output string is ever produced.
+ */
+class ScoringPipeline {
+private:
+    static const size_t CHECK_INTERVAL = 8;
+    
+    const CompiledEnigma& engine;
+    const LanguageModel& model;
+    double boundStep;
+    std::uint64_t candidates;
+    std::uint64_t lettersDecrypted;
+    
+public:
+    ScoringPipeline(const CompiledEnigma& engine, const LanguageModel& model)
+        : engine(engine), model(model), boundStep(model.getBestStep()), candidates(0), lettersDecrypted(0) {}
+    
+    /**
+     * Per-letter bound assumed for the unscored rest of a candidate. The
+     * default (the model's best step) never discards a winner; smaller
+     * values prune much harder at the risk of losing the right key.
+     */
+    void setBoundStep(double step) {
+        boundStep = step;
+    }
+    
+    /**
+     * Score one candidate. Returns false as soon as it cannot exceed the
+     * threshold; otherwise stores the full score and returns true.
+     */
+    bool score(std::uint32_t startState, const std::uint8_t* cipher, size_t length,
+               double threshold, double& result) {
+        const std::uint8_t* plugIn = engine.plugTable(true);
+        const std::uint8_t* plugOut = engine.plugTable(false);
+        
+        std::uint32_t state = startState;
+        int prev = ALPHABET_SIZE;
+        double partial = 0;
+        size_t i = 0;
+        candidates++;
+        
+        while (i < length) {
+            size_t stop = std::min(length, i + CHECK_INTERVAL);
+            for (; i < stop; i++) {
+                state = engine.nextState(state);
+                int letter = plugOut[engine.scramblerTable(state)[plugIn[cipher[i]]]];
+                partial += model.step(prev, letter);
+                prev = letter;
+            }
+            
+            if (partial + (length - i) * boundStep <= threshold) {
+                lettersDecrypted += i;
+                return false;
+            }
+        }
+        
+        lettersDecrypted += length;
+        result = partial;
+        return true;
+    }
+    
+    /**
+     * Try every start state and keep the best few; the threshold is the
+     * weakest score kept so far (or minimumScore, if higher), so it
+     * tightens as the search goes on
+     */
+    std::vector<ScoredCandidate> searchStartStates(const std::uint8_t* cipher, size_t length, size_t keep = 10,
+                                                   double minimumScore = -HUGE_VAL) {
+        if (keep == 0) {
+            return std::vector<ScoredCandidate>();
+        }
+        
+        auto worse = [](const ScoredCandidate& a, const ScoredCandidate& b) { return a.score > b.score; };
+        std::priority_queue<ScoredCandidate, std::vector<ScoredCandidate>, decltype(worse)> best(worse);
+        
+        for (std::uint32_t state = 0; state < engine.getNumStates(); state++) {
+            double threshold = best.size() < keep ? minimumScore : std::max(minimumScore, best.top().score);
+            ScoredCandidate candidate;
+            
+            if (score(state, cipher, length, threshold, candidate.score)) {
+                candidate.state = state;
+                best.push(candidate);
+                if (best.size() > keep) {
+                    best.pop();
+                }
+            }
+        }
+        
+        std::vector<ScoredCandidate> result;
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+    
+    /**
+     * Rank every start state by the index of coincidence of its trial
+     * decryption instead of the language model. The plaintext's letter
+     * frequencies survive a wrong or empty plugboard far better than its
+     * bigrams, so this ranks ground settings before the cabling is known;
+     * there is no early abort, every candidate is decrypted in full.
+     */
+    std::vector<ScoredCandidate> searchStartStatesByCoincidence(const std::uint8_t* cipher, size_t length,
+                                                                size_t keep = 10) {
+        if (keep == 0) {
+            return std::vector<ScoredCandidate>();
+        }
+        
+        auto worse = [](const ScoredCandidate& a, const ScoredCandidate& b) { return a.score > b.score; };
+        std::priority_queue<ScoredCandidate, std::vector<ScoredCandidate>, decltype(worse)> best(worse);
+        
+        for (std::uint32_t state = 0; state < engine.getNumStates(); state++) {
+            ScoredCandidate candidate;
+            candidate.state = state;
+            candidate.score = decryptIndexOfCoincidence(engine, state, cipher, length);
+            candidates++;
+            lettersDecrypted += length;
+            
+            if (best.size() < keep || candidate.score > best.top().score) {
+                best.push(candidate);
+                if (best.size() > keep) {
+                    best.pop();
+                }
+            }
+        }
+        
+        std::vector<ScoredCandidate> result;
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+    
+    /**
+     * Average letters decrypted per candidate so far
+     */
+    double averageLettersPerCandidate() const {
+        return candidates ? static_cast<double>(lettersDecrypted) / candidates : 0.0;
+    }
+};
+
+/**
+ * A point where a garbled intercept was put back in step: skew letters
+ * were missing from it before this cipher letter (positive; the machine
+ * is moved on past them) or garbled into it (negative; they are skipped)
+ */
+struct Resync {
+    size_t position;
+    int skew;
+    size_t latest;      // the model fits the correction as well anywhere up to here
+};
+
+/**
+ * Best-effort plaintext of a garbled intercept, with '?' for each
+ * missing letter and for letters the corrections leave in doubt
+ */
+struct GarbledDecryption {
+    std::string plaintext;
+    std::vector<Resync> resyncs;
+};
+
+/**
+ * Garble-tolerant decryption on a known key. Letters are decrypted on
+ * the compiled engine's tables while a sliding window of language-model
+ * steps tracks how plaintext-like the output is. When the window's
+ * average falls below the midpoint between plaintext and random letters,
+ * sync is taken as lost inside the window: each error position there and
+ * each skew up to maxSkew is scored over the window and the letters that
+ * follow, the state for missing letters found by an O(1) seek. Decryption
+ * resumes from the best correction if that reads as plaintext, and
+ * carries on unchanged otherwise; where the same skew scores about as
+ * well one or two letters either side, the letters between are printed
+ * as '?' rather than guessed. Batches run one intercept per task.
+ */
+class GarbleTolerantDecryptor {
+private:
+    const CompiledEnigma& engine;
+    const LanguageModel& model;
+    size_t window;
+    int maxSkew;
+    double threshold;
+    double tieMargin;       // splices scoring within this many nats are indistinguishable
+    
+    static int decryptLetter(const CompiledEnigma& tables, std::uint32_t state, std::uint8_t cipher) {
+        return tables.plugTable(false)[tables.scramblerTable(state)[tables.plugTable(true)[cipher]]];
+    }
+    
+    // Sum of steps decrypting cipher[from, end) from the state before 'from',
+    // following plaintext letter prev
+    double trial(const CompiledEnigma& tables, const std::vector<std::uint8_t>& cipher,
+                 size_t from, size_t end, std::uint32_t state, int prev) const {
+        double total = 0;
+        for (size_t i = from; i < end; i++) {
+            state = tables.nextState(state);
+            int letter = decryptLetter(tables, state, cipher[i]);
+            total += model.step(prev, letter);
+            prev = letter;
+        }
+        return total;
+    }
+    
+    GarbledDecryption decryptOn(const CompiledEnigma& tables, std::uint32_t startState,
+                                const std::string& ciphertext) const {
+        std::vector<std::uint8_t> cipher = lettersOf(ciphertext);
+        GarbledDecryption result;
+        result.plaintext.reserve(cipher.size());
+        
+        // Per cipher letter: state, plaintext length and plaintext letter
+        // before it, and its step
+        std::vector<std::uint32_t> stateBefore(cipher.size());
+        std::vector<size_t> outputBefore(cipher.size());
+        std::vector<int> letterBefore(cipher.size());
+        std::vector<double> steps(cipher.size());
+        
+        std::uint32_t state = startState;
+        int prev = ALPHABET_SIZE;
+        size_t synced = 0;      // the window only looks back to here
+        size_t earliest = 0;    // corrections go strictly after the last one
+        size_t unknownUntil = 0;
+        double windowSum = 0;
+        size_t i = 0;
+        
+        while (i < cipher.size()) {
+            stateBefore[i] = state;
+            outputBefore[i] = result.plaintext.size();
+            letterBefore[i] = prev;
+            state = tables.nextState(state);
+            int letter = decryptLetter(tables, state, cipher[i]);
+            steps[i] = model.step(prev, letter);
+            prev = letter;
+            result.plaintext += i < unknownUntil ? '?' : indexToChar(letter);
+            
+            windowSum += steps[i];
+            if (i >= synced + window) {
+                windowSum -= steps[i - window];
+            }
+            i++;
+            if (i - synced < window || windowSum >= threshold * window) {
+                continue;
+            }
+            
+            // Lost sync in the window: score each correction over the same
+            // span. Skipped letters leave the trial following the last letter
+            // kept; missing ones leave a gap, so it starts afresh.
+            size_t first = i - window;
+            size_t end = std::min(cipher.size(), i + window);
+            int skews = 2 * maxSkew + 1;
+            std::vector<double> totals((i - first) * skews, -HUGE_VAL);
+            double prefix = 0;
+            double bestScore = -HUGE_VAL;
+            Resync best = {0, 0, 0};
+            for (size_t position = first; position < i; position++) {
+                for (int skew = -maxSkew; skew <= maxSkew && position >= earliest; skew++) {
+                    size_t from = position + (skew < 0 ? -skew : 0);
+                    if (skew == 0 || from >= end) continue;
+                    
+                    std::uint32_t at = skew > 0 ? tables.advance(stateBefore[position], skew) : stateBefore[position];
+                    double total = prefix + trial(tables, cipher, from, end, at,
+                                                  skew < 0 ? letterBefore[position] : ALPHABET_SIZE);
+                    totals[(position - first) * skews + skew + maxSkew] = total;
+                    double score = total / static_cast<double>(position - first + end - from);
+                    if (score > bestScore) {
+                        bestScore = score;
+                        best.position = position;
+                        best.skew = skew;
+                    }
+                }
+                prefix += steps[position];
+            }
+            
+            synced = i;
+            windowSum = 0;
+            if (bestScore < threshold) {
+                continue;
+            }
+            
+            // Neighbouring splice points of the same skew differ only in the
+            // letters between them; when the model cannot tell them apart,
+            // those letters are printed as unknown rather than guessed
+            auto totalAt = [&](size_t position) {
+                return totals[(position - first) * skews + best.skew + maxSkew];
+            };
+            double bestTotal = totalAt(best.position);
+            size_t earliestTie = best.position;
+            best.latest = best.position;
+            while (earliestTie > std::max(first, earliest) && totalAt(earliestTie - 1) > bestTotal - tieMargin) {
+                earliestTie--;
+            }
+            while (best.latest + 1 < i && totalAt(best.latest + 1) > bestTotal - tieMargin) {
+                best.latest++;
+            }
+            
+            best.position = earliestTie;
+            result.plaintext.resize(outputBefore[best.position]);
+            result.plaintext.append(best.skew > 0 ? best.skew : 0, '?');
+            result.resyncs.push_back(best);
+            i = best.position + (best.skew < 0 ? -best.skew : 0);
+            unknownUntil = best.latest + (best.skew < 0 ? -best.skew : 0);
+            state = best.skew > 0 ? tables.advance(stateBefore[best.position], best.skew) : stateBefore[best.position];
+            prev = best.skew < 0 ? letterBefore[best.position] : ALPHABET_SIZE;
+            synced = i;
+            earliest = best.latest + 1;
+        }
+        
+        return result;
+    }
+    
+public:
+    /**
+     * The engine carries the key's wheel order, rings and plugboard;
+     * each intercept brings its own start state
+     */
+    GarbleTolerantDecryptor(const CompiledEnigma& engine, const LanguageModel& model,
+                            size_t window = 32, int maxSkew = 3)
+        : engine(engine), model(model), window(window), maxSkew(maxSkew),
+          threshold((model.getExpectedStep() + model.getRandomStep()) / 2),
+          tieMargin(2 * (model.getExpectedStep() - model.getRandomStep())) {
+        if (window == 0 || maxSkew < 1) {
+            throw std::invalid_argument("Resync needs a window and a skew of at least one letter");
+        }
+    }
+    
+    GarbledDecryption decrypt(std::uint32_t startState, const std::string& ciphertext) const {
+        return decryptOn(engine, startState, ciphertext);
+    }
+    
+    /**
+     * Decrypt a batch of intercepts, each from its start state
+     */
+    std::vector<GarbledDecryption> decryptAll(const std::vector<std::string>& ciphertexts,
+                                              const std::vector<std::uint32_t>& startStates,
+                                              unsigned workers = defaultWorkerCount()) const {
+        if (ciphertexts.size() != startStates.size()) {
+            throw std::invalid_argument("Every intercept needs a start state");
+        }
+        
+        std::vector<GarbledDecryption> results(ciphertexts.size());
+        std::atomic<size_t> nextMessage(0);
+        NodeReplicas<CompiledEnigma> engines(engine);
+        
+        runWorkers(workers, [&](unsigned worker) {
+            const CompiledEnigma& localEngine = engines.forWorker(worker);
+            for (;;) {
+                size_t message = nextMessage.fetch_add(1);
+                if (message >= ciphertexts.size()) break;
+                results[message] = decryptOn(localEngine, startStates[message], ciphertexts[message]);
+            }
+        });
+        
+        return results;
+    }
+};
+
+/**
+ * Result of a UKW-D and plugboard hill-climb
+ */
+struct UkwdSearchResult {
+    std::string reflectorWiring;
+    std::vector<std::pair<char, char>> plugboardPairs;
+    double score;
+    std::string plaintext;
+};
+
+/**
+ * Ciphertext-only hill-climb over UKW-D reflector pairings and plugboard
+ * pairs for a known wheel order, ring setting and start position.
+ * The rotor passes for every message position are computed once; a trial
+ * reflector rewiring only changes the scrambler entries of the four
+ * contacts involved, so no machine is rebuilt per trial.
+ */
+class UkwdSearch {
+private:
+    static const int RESTART_KICKS = 6;
+    
+    std::vector<int> ciphertext;
+    std::vector<std::uint8_t> exitPath;    // per position: reflector contact -> plugboard side
+    std::vector<std::uint8_t> scrambler;   // per position: current scrambler permutation
+    int reflector[ALPHABET_SIZE];
+    int plugboard[ALPHABET_SIZE];
+    
+    // Re-derive the scrambler entries whose reflector contact changed
+    void updateScrambler(const int* contacts, int count) {
+        for (size_t t = 0; t < ciphertext.size(); t++) {
+            const std::uint8_t* out = &exitPath[t * ALPHABET_SIZE];
+            std::uint8_t* table = &scrambler[t * ALPHABET_SIZE];
+            
+            for (int i = 0; i < count; i++) {
+                int contact = contacts[i];
+                table[out[contact]] = out[reflector[contact]];
+            }
+        }
+    }
+    
+    // Same rewiring rule as Reflector::connect; returns the touched contacts
+    int rewireReflector(int a, int b, int* contacts) {
+        int partnerA = reflector[a];
+        int partnerB = reflector[b];
+        
+        reflector[a] = b;
+        reflector[b] = a;
+        reflector[partnerA] = partnerB;
+        reflector[partnerB] = partnerA;
+        
+        contacts[0] = a;
+        contacts[1] = b;
+        contacts[2] = partnerA;
+        contacts[3] = partnerB;
+        return 4;
+    }
+    
+    int plugPairCount() const {
+        int count = 0;
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            if (plugboard[i] > i) count++;
+        }
+        return count;
+    }
+    
+    void unplug(int letter) {
+        int partner = plugboard[letter];
+        plugboard[letter] = letter;
+        plugboard[partner] = partner;
+    }
+    
+    // Index of coincidence of the trial decryption
+    double score() const {
+        return fusedIndexOfCoincidence(ciphertext.size(), [this](size_t t) {
+            return plugboard[scrambler[t * ALPHABET_SIZE + plugboard[ciphertext[t]]]];
+        });
+    }
+    
+    // Alternate reflector and plugboard passes until neither improves
+    double climb(int maxPlugPairs, int maxRounds) {
+        double best = score();
+        int contacts[4];
+        
+        for (int round = 0; round < maxRounds; round++) {
+            bool improved = false;
+            
+            // Reflector pass: try pairing every two letters
+            for (int a = 0; a < ALPHABET_SIZE; a++) {
+                for (int b = a + 1; b < ALPHABET_SIZE; b++) {
+                    if (reflector[a] == b) continue;
+                    
+                    int partnerA = reflector[a];
+                    updateScrambler(contacts, rewireReflector(a, b, contacts));
+                    
+                    double trial = score();
+                    if (trial > best) {
+                        best = trial;
+                        improved = true;
+                    } else {
+                        updateScrambler(contacts, rewireReflector(a, partnerA, contacts));
+                    }
+                }
+            }
+            
+            // Plugboard pass: toggle every possible cable
+            for (int a = 0; a < ALPHABET_SIZE && maxPlugPairs > 0; a++) {
+                for (int b = a + 1; b < ALPHABET_SIZE; b++) {
+                    int saved[ALPHABET_SIZE];
+                    std::copy(plugboard, plugboard + ALPHABET_SIZE, saved);
+                    
+                    if (plugboard[a] == b) {
+                        unplug(a);
+                    } else {
+                        unplug(a);
+                        unplug(b);
+                        if (plugPairCount() >= maxPlugPairs) {
+                            std::copy(saved, saved + ALPHABET_SIZE, plugboard);
+                            continue;
+                        }
+                        plugboard[a] = b;
+                        plugboard[b] = a;
+                    }
+                    
+                    double trial = score();
+                    if (trial > best) {
+                        best = trial;
+                        improved = true;
+                    } else {
+                        std::copy(saved, saved + ALPHABET_SIZE, plugboard);
+                    }
+                }
+            }
+            
+            if (!improved) break;
+        }
+        
+        return best;
+    }
+    
+public:
+    /**
+     * The machine supplies the wheels, ring settings and start position;
+     * its reflector and plugboard are the starting guess
+     */
+    UkwdSearch(const EnigmaMachine& machine, const std::string& message) {
+        EnigmaMachine stepper(machine);
+        const Reflector& startReflector = machine.getReflector();
+        
+        std::vector<std::uint8_t> letters = lettersOf(message);
+        ciphertext.assign(letters.begin(), letters.end());
+        
+        exitPath.resize(ciphertext.size() * ALPHABET_SIZE);
+        scrambler.resize(ciphertext.size() * ALPHABET_SIZE);
+        
+        for (size_t t = 0; t < ciphertext.size(); t++) {
+            stepper.step();
+            for (int signal = 0; signal < ALPHABET_SIZE; signal++) {
+                char contact = stepper.forwardPass(indexToChar(signal));
+                int offsetContact = startReflector.applyOffset(charToIndex(contact), true);
+                exitPath[t * ALPHABET_SIZE + offsetContact] = static_cast<std::uint8_t>(signal);
+            }
+        }
+        
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            reflector[i] = charToIndex(startReflector.getWiring()[i]);
+            plugboard[i] = charToIndex(machine.getPlugboard().process(indexToChar(i)));
+        }
+        
+        int all[ALPHABET_SIZE];
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            all[i] = i;
+        }
+        updateScrambler(all, ALPHABET_SIZE);
+    }
+    
+    /**
+     * Hill-climb from the starting guess, then restart from the best
+     * wiring so far with a few reflector pairs rewired at random, since
+     * a single climb on the index of coincidence often stalls a couple
+     * of pairs short. With maxPlugPairs zero the starting plugboard is
+     * taken as known (from the day's key) and only the reflector is
+     * climbed, which converges on far shorter messages than the joint
+     * search.
+     */
+    UkwdSearchResult run(int maxPlugPairs = 10, int maxRounds = 50, int restarts = 20, unsigned seed = 1) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> letter(0, ALPHABET_SIZE - 1);
+        int all[ALPHABET_SIZE];
+        int contacts[4];
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            all[i] = i;
+        }
+        
+        double best = climb(maxPlugPairs, maxRounds);
+        int bestReflector[ALPHABET_SIZE];
+        int bestPlugboard[ALPHABET_SIZE];
+        std::copy(reflector, reflector + ALPHABET_SIZE, bestReflector);
+        std::copy(plugboard, plugboard + ALPHABET_SIZE, bestPlugboard);
+        
+        for (int restart = 0; restart < restarts; restart++) {
+            for (int kick = 0; kick < RESTART_KICKS; kick++) {
+                int a = letter(rng);
+                int b = letter(rng);
+                if (a != b) {
+                    updateScrambler(contacts, rewireReflector(a, b, contacts));
+                }
+            }
+            
+            double trial = climb(maxPlugPairs, maxRounds);
+            if (trial > best) {
+                best = trial;
+                std::copy(reflector, reflector + ALPHABET_SIZE, bestReflector);
+                std::copy(plugboard, plugboard + ALPHABET_SIZE, bestPlugboard);
+            } else {
+                std::copy(bestReflector, bestReflector + ALPHABET_SIZE, reflector);
+                std::copy(bestPlugboard, bestPlugboard + ALPHABET_SIZE, plugboard);
+                updateScrambler(all, ALPHABET_SIZE);
+            }
+        }
+        
+        UkwdSearchResult result;
+        result.score = best;
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            result.reflectorWiring += indexToChar(reflector[i]);
+            if (plugboard[i] > i) {
+                result.plugboardPairs.push_back(std::make_pair(indexToChar(i), indexToChar(plugboard[i])));
+            }
+        }
+        for (size_t t = 0; t < ciphertext.size(); t++) {
+            const std::uint8_t* table = &scrambler[t * ALPHABET_SIZE];
+            result.plaintext += indexToChar(plugboard[table[plugboard[ciphertext[t]]]]);
+        }
+        
+        return result;
+    }
+};
+
+/**
+ * Two messages found to be in depth: message 'second' starts 'offset'
+ * key-stream positions after message 'first'
+ */
+struct DepthMatch {
+    size_t first;
+    size_t second;
+    long offset;
+    size_t overlap;
+    size_t coincidences;
+    double sigma;   // standard deviations above the random rate of 1/26
+};
+
+/**
+ * Messages sharing one key stream, with each message's starting offset,
+ * and any weaker matches within the group whose offset contradicts them
+ */
+struct DepthGroup {
+    std::vector<size_t> messages;
+    std::vector<long> offsets;
+    std::vector<DepthMatch> conflicts;
+};
+
+/**
+ * Depth detection across an intercept corpus. Texts enciphered on the
+ * same key stream coincide letter for letter at the plaintext rate
+ * (about 1/13 for German) instead of the random 1/26, so every pair is
+ * compared at every candidate alignment with the vectorized coincidence
+ * counter and kept when the excess is significant. Rows of the pair
+ * matrix are handed out to the workers in shards, so the comparison
+ * scales across cores.
+ */
+class DepthDetector {
+private:
+    static const size_t SHARD_ROWS = 16;
+    
+    std::vector<std::vector<std::uint8_t>> messages;
+    double minSigma;
+    size_t minOverlap;
+    
+    bool compare(size_t first, size_t second, long offset, DepthMatch& match) const {
+        const std::vector<std::uint8_t>& a = messages[first];
+        const std::vector<std::uint8_t>& b = messages[second];
+        size_t skipA = offset > 0 ? offset : 0;
+        size_t skipB = offset < 0 ? -offset : 0;
+        
+        if (skipA >= a.size() || skipB >= b.size()) {
+            return false;
+        }
+        
+        size_t overlap = std::min(a.size() - skipA, b.size() - skipB);
+        if (overlap < minOverlap) {
+            return false;
+        }
+        
+        match.first = first;
+        match.second = second;
+        match.offset = offset;
+        match.overlap = overlap;
+        match.coincidences = countCoincidences(&a[skipA], &b[skipB], overlap);
+        
+        const double random = 1.0 / ALPHABET_SIZE;
+        double expected = overlap * random;
+        match.sigma = (match.coincidences - expected) / std::sqrt(expected * (1.0 - random));
+        return match.sigma >= minSigma;
+    }
+    
+    // Union-find keeping each message's offset relative to its parent;
+    // the first pass sums the offsets up to the root, the second points
+    // the whole path straight at the root
+    static size_t findRoot(std::vector<size_t>& parent, std::vector<long>& relative, size_t node) {
+        size_t root = node;
+        long offset = 0;
+        while (parent[root] != root) {
+            offset += relative[root];
+            root = parent[root];
+        }
+        
+        while (node != root) {
+            size_t up = parent[node];
+            long rest = offset - relative[node];
+            relative[node] = offset;
+            parent[node] = root;
+            offset = rest;
+            node = up;
+        }
+        return root;
+    }
+    
+public:
+    /**
+     * minSigma should grow with the number of pairs and offsets tried,
+     * or chance alignments will pass
+     */
+    DepthDetector(double minSigma = 5.0, size_t minOverlap = 30)
+        : minSigma(minSigma), minOverlap(minOverlap) {}
+    
+    /**
+     * Add an intercept; only its letters are kept. Returns its index.
+     */
+    size_t addMessage(const std::string& text) {
+        messages.push_back(lettersOf(text));
+        return messages.size() - 1;
+    }
+    
+    size_t getMessageCount() const {
+        return messages.size();
+    }
+    
+    /**
+     * Compare every pair of messages at every offset in [-maxOffset,
+     * maxOffset] and keep the best alignment of each pair in depth
+     */
+    std::vector<DepthMatch> findMatches(long maxOffset = 0, unsigned workers = defaultWorkerCount()) const {
+        workers = std::max(workers, 1u);
+        std::vector<std::vector<DepthMatch>> found(workers);
+        std::atomic<size_t> nextShard(0);
+        size_t count = messages.size();
+        
+        runWorkers(workers, [&](unsigned worker) {
+            for (;;) {
+                size_t begin = nextShard.fetch_add(SHARD_ROWS);
+                if (begin >= count) break;
+                size_t end = std::min(count, begin + SHARD_ROWS);
+                
+                for (size_t first = begin; first < end; first++) {
+                    for (size_t second = first + 1; second < count; second++) {
+                        DepthMatch best, trial;
+                        bool inDepth = false;
+                        
+                        for (long offset = -maxOffset; offset <= maxOffset; offset++) {
+                            if (compare(first, second, offset, trial) && (!inDepth || trial.sigma > best.sigma)) {
+                                best = trial;
+                                inDepth = true;
+                            }
+                        }
+                        
+                        if (inDepth) {
+                            found[worker].push_back(best);
+                        }
+                    }
+                }
+            }
+        });
+        
+        std::vector<DepthMatch> matches;
+        for (const auto& local : found) {
+            matches.insert(matches.end(), local.begin(), local.end());
+        }
+        std::sort(matches.begin(), matches.end(), [](const DepthMatch& a, const DepthMatch& b) {
+            return a.sigma > b.sigma;
+        });
+        return matches;
+    }
+    
+    /**
+     * Merge pairwise matches, strongest first, into groups on a common
+     * key stream. A match contradicting an earlier alignment does not
+     * move any message; it is reported in its group's conflicts.
+     */
+    std::vector<DepthGroup> groupMatches(const std::vector<DepthMatch>& matches) const {
+        std::vector<size_t> parent(messages.size());
+        std::vector<long> relative(messages.size(), 0);
+        std::vector<size_t> size(messages.size(), 1);
+        for (size_t i = 0; i < parent.size(); i++) {
+            parent[i] = i;
+        }
+        
+        std::vector<DepthMatch> conflicts;
+        for (const DepthMatch& match : matches) {
+            size_t rootA = findRoot(parent, relative, match.first);
+            size_t rootB = findRoot(parent, relative, match.second);
+            long shift = relative[match.first] + match.offset - relative[match.second];
+            if (rootA == rootB) {
+                if (shift != 0) {
+                    conflicts.push_back(match);
+                }
+            } else if (size[rootA] >= size[rootB]) {
+                parent[rootB] = rootA;
+                relative[rootB] = shift;
+                size[rootA] += size[rootB];
+            } else {
+                parent[rootA] = rootB;
+                relative[rootA] = -shift;
+                size[rootB] += size[rootA];
+            }
+        }
+        
+        std::map<size_t, DepthGroup> byRoot;
+        for (size_t i = 0; i < messages.size(); i++) {
+            size_t root = findRoot(parent, relative, i);
+            byRoot[root].messages.push_back(i);
+            byRoot[root].offsets.push_back(relative[i]);
+        }
+        for (const DepthMatch& match : conflicts) {
+            byRoot[findRoot(parent, relative, match.first)].conflicts.push_back(match);
+        }
+        
+        std::vector<DepthGroup> groups;
+        for (auto& entry : byRoot) {
+            DepthGroup& group = entry.second;
+            if (group.messages.size() < 2) continue;
+            
+            long lowest = *std::min_element(group.offsets.begin(), group.offsets.end());
+            for (long& offset : group.offsets) {
+                offset -= lowest;
+            }
+            groups.push_back(group);
+        }
+        
+        return groups;
+    }
+    
+    /**
+     * Decrypt a whole group from one key stream, given an engine set to
+     * the group's starting key
+     */
+    std::vector<std::string> decryptGroup(const DepthGroup& group, const CompiledEnigma& engine) const {
+        size_t length = 0;
+        for (size_t i = 0; i < group.messages.size(); i++) {
+            length = std::max(length, group.offsets[i] + messages[group.messages[i]].size());
+        }
+        
+        KeyStream keyStream(engine, length);
+        std::vector<std::string> plaintexts;
+        
+        for (size_t i = 0; i < group.messages.size(); i++) {
+            const std::vector<std::uint8_t>& letters = messages[group.messages[i]];
+            std::string plaintext;
+            for (size_t k = 0; k < letters.size(); k++) {
+                plaintext += indexToChar(keyStream.encryptIndex(group.offsets[i] + k, letters[k]));
+            }
+            plaintexts.push_back(plaintext);
+        }
+        
+        return plaintexts;
+    }
+};
+
+/**
+ * A crib placement consistent with the ciphertext: the machine set to
+ * startState (before the first key press) encrypts the crib to the
+ * ciphertext at the given letter position
+ */
+struct CribHit {
+    size_t crib;
+    size_t position;
+    std::uint32_t startState;
+};
+
+/**
+ * Crib dragging. Enigma never encrypts a letter to itself, so a probable
+ * word can only sit where no crib letter equals the ciphertext letter
+ * under it; positions are pruned with the vectorized compare before any
+ * rotor state is looked at. Each surviving position is then checked
+ * against the rotor states on the compiled engine, with the engine's
+ * current plugboard: the first crib letter picks its bucket of states
+ * from an index, and each is followed until a letter fails. Cribs can
+ * be dragged one at a time or as a dictionary, sharded across workers.
+ */
+class CribDragger {
+private:
+    static const size_t SHARD_SIZE = 8;
+    
+    std::vector<std::uint8_t> cipher;
+    std::vector<std::vector<std::uint8_t>> cribs;
+    
+    /**
+     * Scrambler states bucketed by the letter pair they map, so a crib's
+     * first letter selects the ~1/26 of states consistent with it
+     */
+    struct StateIndex {
+        std::vector<std::uint32_t> bucketStart;
+        std::vector<std::uint32_t> states;
+        
+        explicit StateIndex(const CompiledEnigma& engine)
+            : bucketStart(ALPHABET_SIZE * ALPHABET_SIZE + 1, 0),
+              states(static_cast<size_t>(engine.getNumStates()) * ALPHABET_SIZE) {
+            std::uint32_t numStates = engine.getNumStates();
+            for (std::uint32_t state = 0; state < numStates; state++) {
+                const std::uint8_t* table = engine.scramblerTable(state);
+                for (int signal = 0; signal < ALPHABET_SIZE; signal++) {
+                    bucketStart[signal * ALPHABET_SIZE + table[signal] + 1]++;
+                }
+            }
+            for (size_t bucket = 1; bucket < bucketStart.size(); bucket++) {
+                bucketStart[bucket] += bucketStart[bucket - 1];
+            }
+            
+            std::vector<std::uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+            for (std::uint32_t state = 0; state < numStates; state++) {
+                const std::uint8_t* table = engine.scramblerTable(state);
+                for (int signal = 0; signal < ALPHABET_SIZE; signal++) {
+                    states[fill[signal * ALPHABET_SIZE + table[signal]]++] = state;
+                }
+            }
+        }
+    };
+    
+    void checkStates(const CompiledEnigma& engine, const StateIndex& index,
+                     size_t crib, size_t position, std::vector<CribHit>& hits) const {
+        const std::uint8_t* plugIn = engine.plugTable(true);
+        const std::uint8_t* plugOut = engine.plugTable(false);
+        const std::vector<std::uint8_t>& word = cribs[crib];
+        const std::uint8_t* target = &cipher[position];
+        
+        // Scrambler output that the exit plugboard turns into the first cipher letter
+        int first = 0;
+        while (plugOut[first] != target[0]) {
+            first++;
+        }
+        int bucket = plugIn[word[0]] * ALPHABET_SIZE + first;
+        
+        for (std::uint32_t i = index.bucketStart[bucket]; i < index.bucketStart[bucket + 1]; i++) {
+            std::uint32_t state = index.states[i];
+            size_t k = 1;
+            for (; k < word.size(); k++) {
+                state = engine.nextState(state);
+                if (plugOut[engine.scramblerTable(state)[plugIn[word[k]]]] != target[k]) break;
+            }
+            
+            if (k == word.size()) {
+                CribHit hit;
+                hit.crib = crib;
+                hit.position = position;
+                hit.startState = engine.advance(index.states[i], -static_cast<std::int64_t>(position + 1));
+                hits.push_back(hit);
+            }
+        }
+    }
+    
+public:
+    explicit CribDragger(const std::string& ciphertext)
+        : cipher(lettersOf(ciphertext)) {}
+    
+    /**
+     * Add a probable word to the dictionary; only its letters are kept.
+     * Returns its index.
+     */
+    size_t addCrib(const std::string& crib) {
+        std::vector<std::uint8_t> letters = lettersOf(crib);
+        if (letters.empty()) {
+            throw std::invalid_argument("Crib must contain at least one letter");
+        }
+        cribs.push_back(letters);
+        return cribs.size() - 1;
+    }
+    
+    size_t getCribCount() const {
+        return cribs.size();
+    }
+    
+    /**
+     * Positions where a crib could stand without any letter encrypting
+     * to itself
+     */
+    std::vector<size_t> candidatePositions(size_t crib) const {
+        const std::vector<std::uint8_t>& word = cribs[crib];
+        std::vector<size_t> positions;
+        
+        for (size_t position = 0; position + word.size() <= cipher.size(); position++) {
+            if (!hasCoincidence(&word[0], &cipher[position], word.size())) {
+                positions.push_back(position);
+            }
+        }
+        
+        return positions;
+    }
+    
+    /**
+     * Drag every crib in the dictionary over the ciphertext and return
+     * each (crib, position, start state) the engine's wheels and
+     * plugboard are consistent with
+     */
+    std::vector<CribHit> drag(const CompiledEnigma& engine, unsigned workers = defaultWorkerCount()) const {
+        workers = std::max(workers, 1u);
+        StateIndex index(engine);
+        std::vector<std::pair<size_t, size_t>> placements;
+        for (size_t crib = 0; crib < cribs.size(); crib++) {
+            for (size_t position : candidatePositions(crib)) {
+                placements.push_back(std::make_pair(crib, position));
+            }
+        }
+        
+        std::vector<std::vector<CribHit>> found(workers);
+        std::atomic<size_t> nextShard(0);
+        NodeReplicas<CompiledEnigma> engines(engine);
+        NodeReplicas<StateIndex> indexes(index);
+        
+        runWorkers(workers, [&](unsigned worker) {
+            const CompiledEnigma& localEngine = engines.forWorker(worker);
+            const StateIndex& localIndex = indexes.forWorker(worker);
+            
+            for (;;) {
+                size_t begin = nextShard.fetch_add(SHARD_SIZE);
+                if (begin >= placements.size()) break;
+                size_t end = std::min(placements.size(), begin + SHARD_SIZE);
+                
+                for (size_t i = begin; i < end; i++) {
+                    checkStates(localEngine, localIndex, placements[i].first, placements[i].second, found[worker]);
+                }
+            }
+        });
+        
+        std::vector<CribHit> hits;
+        for (const auto& local : found) {
+            hits.insert(hits.end(), local.begin(), local.end());
+        }
+        std::sort(hits.begin(), hits.end(), [](const CribHit& a, const CribHit& b) {
+            if (a.crib != b.crib) return a.crib < b.crib;
+            if (a.position != b.position) return a.position < b.position;
+            return a.startState < b.startState;
+        });
+        return hits;
+    }
+};
+
+/**
+ * One link of a Bombe menu: plain and cipher letters joined by the
+ * scrambler 'step' key presses after the menu's first letter
+ */
+struct MenuEdge {
+    int plain;
+    int cipher;
+    size_t step;
+};
+
+/**
+ * A Bombe menu: the connected crib/ciphertext letter graph of one crib
+ * window at one alignment, reduced to its best-looped component
+ */
+struct BombeMenu {
+    size_t position;        // ciphertext letter under the menu's first edge
+    size_t begin;           // window start within the crib
+    size_t length;          // window length
+    std::vector<MenuEdge> edges;
+    int testLetter;         // most connected letter, fed by the test register
+    int letters;
+    int loops;              // closures: edges - letters + 1
+    double expectedStops;   // false stops per wheel order
+};
+
+/**
+ * Bombe menu builder. Each crib window at each alignment gives a letter
+ * graph; the component with the most closures is kept, since every loop
+ * cuts the chance that a wrong rotor position survives the test by about
+ * 26. Menus expecting almost no false stops are ranked shortest first,
+ * as a short span is cheaper to test and less likely to contain a
+ * middle-wheel turnover; the rest by closures.
+ */
+class MenuBuilder {
+private:
+    // False stops per wheel order below which more closures buy nothing
+    static constexpr double ENOUGH_STOPS = 0.01;
+    
+    std::vector<std::uint8_t> cipher;
+    std::vector<std::uint8_t> crib;
+    
+    static int findRoot(int* parent, int letter) {
+        while (parent[letter] != letter) {
+            letter = parent[letter] = parent[parent[letter]];
+        }
+        return letter;
+    }
+    
+public:
+    MenuBuilder(const std::string& ciphertext, const std::string& crib)
+        : cipher(lettersOf(ciphertext)), crib(lettersOf(crib)) {}
+    
+    /**
+     * Menu for crib letters [begin, begin + length) with the crib's first
+     * letter over ciphertext letter 'alignment'
+     */
+    BombeMenu build(size_t alignment, size_t begin, size_t length) const {
+        if (begin + length > crib.size() || alignment + begin + length > cipher.size()) {
+            throw std::invalid_argument("Menu window outside the crib or ciphertext");
+        }
+        
+        int parent[ALPHABET_SIZE], edgeCount[ALPHABET_SIZE], letterCount[ALPHABET_SIZE], degree[ALPHABET_SIZE];
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            parent[letter] = letter;
+            edgeCount[letter] = letterCount[letter] = degree[letter] = 0;
+        }
+        
+        for (size_t k = begin; k < begin + length; k++) {
+            int a = crib[k], b = cipher[alignment + k];
+            degree[a]++;
+            degree[b]++;
+            parent[findRoot(parent, a)] = findRoot(parent, b);
+        }
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            if (degree[letter]) {
+                letterCount[findRoot(parent, letter)]++;
+            }
+        }
+        for (size_t k = begin; k < begin + length; k++) {
+            edgeCount[findRoot(parent, crib[k])]++;
+        }
+        
+        // The component with the most closures, then the most letters
+        int best = -1;
+        for (int root = 0; root < ALPHABET_SIZE; root++) {
+            if (!letterCount[root]) continue;
+            int loops = edgeCount[root] - letterCount[root] + 1;
+            int bestLoops = best < 0 ? -1 : edgeCount[best] - letterCount[best] + 1;
+            if (loops > bestLoops || (loops == bestLoops && letterCount[root] > letterCount[best])) {
+                best = root;
+            }
+        }
+        
+        BombeMenu menu;
+        menu.position = alignment + begin;
+        menu.begin = begin;
+        menu.length = length;
+        menu.letters = letterCount[best];
+        menu.loops = edgeCount[best] - letterCount[best] + 1;
+        menu.testLetter = -1;
+        
+        for (size_t k = begin; k < begin + length; k++) {
+            MenuEdge edge;
+            edge.plain = crib[k];
+            edge.cipher = cipher[alignment + k];
+            edge.step = k - begin;
+            if (findRoot(parent, edge.plain) != best) continue;
+            menu.edges.push_back(edge);
+            
+            for (int letter : {edge.plain, edge.cipher}) {
+                if (menu.testLetter < 0 || degree[letter] > degree[menu.testLetter]) {
+                    menu.testLetter = letter;
+                }
+            }
+        }
+        
+        menu.expectedStops = ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE * std::pow(ALPHABET_SIZE, -menu.loops);
+        return menu;
+    }
+    
+    /**
+     * Every window of at least minLength crib letters at each alignment,
+     * best first. Alignments where a letter would encrypt to itself
+     * should be pruned by the caller (CribDragger::candidatePositions).
+     */
+    std::vector<BombeMenu> enumerate(const std::vector<size_t>& alignments, size_t minLength = 8) const {
+        std::vector<BombeMenu> menus;
+        
+        for (size_t alignment : alignments) {
+            for (size_t begin = 0; begin + minLength <= crib.size(); begin++) {
+                for (size_t length = minLength; begin + length <= crib.size(); length++) {
+                    if (alignment + begin + length > cipher.size()) break;
+                    menus.push_back(build(alignment, begin, length));
+                }
+            }
+        }
+        
+        std::stable_sort(menus.begin(), menus.end(), [](const BombeMenu& a, const BombeMenu& b) {
+            bool goodA = a.expectedStops <= ENOUGH_STOPS, goodB = b.expectedStops <= ENOUGH_STOPS;
+            if (goodA != goodB) return goodA;
+            if (goodA && a.length != b.length) return a.length < b.length;
+            if (a.loops != b.loops) return a.loops > b.loops;
+            return a.length < b.length;
+        });
+        return menus;
+    }
+    
+    /**
+     * The best menu over the given alignments
+     */
+    BombeMenu best(const std::vector<size_t>& alignments, size_t minLength = 8) const {
+        std::vector<BombeMenu> menus = enumerate(alignments, minLength);
+        if (menus.empty()) {
+            throw std::invalid_argument("Crib too short for a menu at any alignment");
+        }
+        return menus.front();
+    }
+};
+
+/**
+ * The Bombe's 26x26 stecker hypothesis matrix as one bitset row per
+ * letter: bit y of row x means "x is steckered to y" follows from the
+ * assumption. Only bits new since a row was last visited are pushed
+ * through the scramblers, and the diagonal board's mirror image is kept
+ * by setting bit x of row y alongside.
+ */
+class HypothesisMatrix {
+public:
+    static const std::uint32_t ALL = (1u << ALPHABET_SIZE) - 1;
+    
+private:
+    std::uint32_t rows[ALPHABET_SIZE];
+    std::uint32_t delta[ALPHABET_SIZE];
+    std::uint32_t dirty;    // letters with a non-empty delta
+    
+    void light(int letter, std::uint32_t bits) {
+        bits &= ~rows[letter];
+        if (!bits) return;
+        rows[letter] |= bits;
+        delta[letter] |= bits;
+        dirty |= 1u << letter;
+    }
+    
+public:
+    HypothesisMatrix() : dirty(0) {
+        std::fill(rows, rows + ALPHABET_SIZE, 0);
+        std::fill(delta, delta + ALPHABET_SIZE, 0);
+    }
+    
+    void assume(int letter, int partner) {
+        light(letter, 1u << partner);
+        light(partner, 1u << letter);
+    }
+    
+    std::uint32_t row(int letter) const {
+        return rows[letter];
+    }
+    
+    /**
+     * Propagate to a fixed point through the menu links (per letter: other
+     * letter and scrambler index). Returns false as soon as the watched
+     * row is full, i.e. every hypothesis for it is contradicted.
+     */
+    bool propagate(const std::vector<std::vector<std::pair<int, size_t>>>& links,
+                   const Permutation* scramblers, int watch) {
+        while (dirty) {
+            int letter = lowestSetBit(dirty);
+            std::uint32_t bits = delta[letter];
+            delta[letter] = 0;
+            dirty &= dirty - 1;
+            
+            // Map the new partners through every scrambler on the letter
+            // (an involution, so the vector preimage equals the image)
+            for (const auto& link : links[letter]) {
+#ifdef __SSSE3__
+                light(link.first, scramblers[link.second].preimageOf(bits));
+#else
+                light(link.first, scramblers[link.second].imageOf(bits));
+#endif
+            }
+            
+            // Diagonal board
+            for (std::uint32_t rest = bits; rest; rest &= rest - 1) {
+                light(lowestSetBit(rest), 1u << letter);
+            }
+            
+            if (rows[watch] == ALL) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * A Bombe stop: a wheel order and scrambler state at the menu's first
+ * letter that survived the test, with the test letter's stecker partner
+ * when the test register identifies it (-1 otherwise)
+ */
+struct BombeStop {
+    int wheels[3];
+    std::uint32_t state;
+    int left;
+    int middle;
+    int right;
+    int stecker;
+};
+
+/**
+ * Bombe. For each scrambler state the test letter is assumed steckered
+ * to one letter and the consequences are propagated through the menu's
+ * scramblers in a HypothesisMatrix, with the diagonal board adding every
+ * implied pair's mirror image. If the test register lights up completely
+ * the assumption and every alternative are contradicted and the state is
+ * rejected; anything else is a stop. Rings are taken as A, so a
+ * middle-wheel turnover inside the menu's span loses the stop, as on the
+ * real machine.
+ */
+class Bombe {
+private:
+    BombeMenu menu;
+    std::vector<std::vector<std::pair<int, size_t>>> links;   // per letter: (other letter, edge)
+    size_t span;
+    
+    // True if the test register is not fully lit; reports the stecker if it is decided
+    bool test(const Permutation* scramblers, int& stecker) const {
+        HypothesisMatrix matrix;
+        matrix.assume(menu.testLetter, 0);
+        if (!matrix.propagate(links, scramblers, menu.testLetter)) {
+            return false;
+        }
+        
+        std::uint32_t row = matrix.row(menu.testLetter);
+        int count = setBitCount(row);
+        stecker = count == 1 ? lowestSetBit(row)
+                : count == ALPHABET_SIZE - 1 ? lowestSetBit(~row & HypothesisMatrix::ALL)
+                : -1;
+        return true;
+    }
+    
+public:
+    explicit Bombe(const BombeMenu& menu)
+        : menu(menu), links(ALPHABET_SIZE), span(0) {
+        if (menu.edges.empty()) {
+            throw std::invalid_argument("Bombe menu has no edges");
+        }
+        for (size_t e = 0; e < menu.edges.size(); e++) {
+            const MenuEdge& edge = menu.edges[e];
+            links[edge.plain].push_back(std::make_pair(edge.cipher, e));
+            links[edge.cipher].push_back(std::make_pair(edge.plain, e));
+            span = std::max(span, edge.step + 1);
+        }
+    }
+    
+    /**
+     * Test every scrambler state of one compiled wheel order; stops are
+     * given as the state before the menu's first key press
+     */
+    std::vector<BombeStop> run(const CompiledEnigma& engine) const {
+        std::vector<BombeStop> stops;
+        std::vector<std::uint32_t> states(span);
+        std::vector<Permutation> scramblers(menu.edges.size());
+        
+        for (std::uint32_t start = 0; start < engine.getNumStates(); start++) {
+            std::uint32_t state = start;
+            for (size_t step = 0; step < span; step++) {
+                states[step] = state = engine.nextState(state);
+            }
+            for (size_t e = 0; e < menu.edges.size(); e++) {
+                scramblers[e] = Permutation::fromTable(engine.scramblerTable(states[menu.edges[e].step]), ALPHABET_SIZE);
+            }
+            
+            BombeStop stop;
+            if (test(&scramblers[0], stop.stecker)) {
+                stop.wheels[0] = stop.wheels[1] = stop.wheels[2] = 0;
+                stop.state = start;
+                stop.left = engine.rotorPositionOf(start, 0);
+                stop.middle = engine.rotorPositionOf(start, 1);
+                stop.right = engine.rotorPositionOf(start, 2);
+                stops.push_back(stop);
+            }
+        }
+        
+        return stops;
+    }
+    
+    /**
+     * Run the menu on all 60 orders of wheels I-V with the given
+     * reflector, one wheel order per task
+     */
+    std::vector<BombeStop> searchWheelOrders(const Reflector& reflector,
+                                             unsigned workers = defaultWorkerCount()) const {
+        std::vector<std::array<int, 3>> orders = allWheelOrders();
+        std::vector<std::vector<BombeStop>> found(orders.size());
+        std::atomic<size_t> nextOrder(0);
+        
+        runWorkers(workers, [&](unsigned) {
+            for (;;) {
+                size_t order = nextOrder.fetch_add(1);
+                if (order >= orders.size()) break;
+                
+                std::vector<Rotor> rotors = {
+                    EnigmaFactory::createRotor(orders[order][0]),
+                    EnigmaFactory::createRotor(orders[order][1]),
+                    EnigmaFactory::createRotor(orders[order][2])
+                };
+                CompiledEnigma engine(EnigmaMachine(rotors, reflector));
+                
+                found[order] = run(engine);
+                for (BombeStop& stop : found[order]) {
+                    std::copy(orders[order].begin(), orders[order].end(), stop.wheels);
+                }
+            }
+        });
+        
+        std::vector<BombeStop> stops;
+        for (const auto& local : found) {
+            stops.insert(stops.end(), local.begin(), local.end());
+        }
+        return stops;
+    }
+};
+
+/**
+ * Ring-setting elimination by turnover timing. The scrambler only sees
+ * each wheel's offset (position - ring); the positions matter only for
+ * when the notches step the next wheel. Over a window of key presses the
+ * left wheel's position never matters, and the middle and right wheel
+ * positions matter only through the turnovers they cause inside the
+ * window. All 676 (middle, right) positions are stepped through the
+ * window and grouped by the steps they produce, so each class with any
+ * start offsets is one effective scrambler sequence, however many
+ * (position, ring) settings share it.
+ */
+class TurnoverClasses {
+private:
+    size_t window;
+    std::vector<int> classOfPositions;                      // middle * 26 + right
+    std::vector<std::vector<std::pair<int, int>>> members;  // (middle, right) positions
+    std::vector<std::vector<std::uint8_t>> middleSteps;     // per class, steps taken by press t + 1
+    std::vector<std::vector<std::uint8_t>> leftSteps;
+    
+public:
+    TurnoverClasses(const EnigmaMachine& machine, size_t window)
+        : window(window), classOfPositions(ALPHABET_SIZE * ALPHABET_SIZE) {
+        if (machine.getSteppingMode() != SteppingMode::Ratchet) {
+            throw std::invalid_argument("Turnover classes need ratchet stepping");
+        }
+        
+        EnigmaMachine stepper(machine);
+        std::map<std::vector<std::uint8_t>, int> bySignature;
+        
+        for (int middle = 0; middle < ALPHABET_SIZE; middle++) {
+            for (int right = 0; right < ALPHABET_SIZE; right++) {
+                stepper.setRotorPositions(0, middle, right);
+                
+                // Cumulative left and middle steps after each press
+                std::vector<std::uint8_t> signature(2 * window);
+                for (size_t t = 0; t < window; t++) {
+                    stepper.step();
+                    signature[2 * t] = static_cast<std::uint8_t>(stepper.getRotors()[0].getPosition());
+                    signature[2 * t + 1] = static_cast<std::uint8_t>(
+                        (stepper.getRotors()[1].getPosition() - middle + ALPHABET_SIZE) % ALPHABET_SIZE);
+                }
+                
+                auto found = bySignature.find(signature);
+                int cls;
+                if (found == bySignature.end()) {
+                    cls = members.size();
+                    bySignature[signature] = cls;
+                    members.push_back(std::vector<std::pair<int, int>>());
+                    leftSteps.push_back(std::vector<std::uint8_t>(window));
+                    middleSteps.push_back(std::vector<std::uint8_t>(window));
+                    for (size_t t = 0; t < window; t++) {
+                        leftSteps[cls][t] = signature[2 * t];
+                        middleSteps[cls][t] = signature[2 * t + 1];
+                    }
+                } else {
+                    cls = found->second;
+                }
+                
+                classOfPositions[middle * ALPHABET_SIZE + right] = cls;
+                members[cls].push_back(std::make_pair(middle, right));
+            }
+        }
+    }
+    
+    size_t getWindow() const {
+        return window;
+    }
+    
+    size_t getClassCount() const {
+        return members.size();
+    }
+    
+    int classOf(int middlePosition, int rightPosition) const {
+        return classOfPositions[middlePosition * ALPHABET_SIZE + rightPosition];
+    }
+    
+    /**
+     * (middle, right) start positions sharing a class
+     */
+    const std::vector<std::pair<int, int>>& getMembers(int cls) const {
+        return members[cls];
+    }
+    
+    /**
+     * True if the middle wheel steps on key press t (0-based) in a class;
+     * the right wheel turns over on exactly those presses
+     */
+    bool turnoverAt(int cls, size_t t) const {
+        return middleSteps[cls][t] != (t ? middleSteps[cls][t - 1] : 0);
+    }
+    
+    /**
+     * Turnovers every start position must, or can, see inside the window:
+     * a press is in 'always' if the middle wheel steps there in every
+     * class and in 'sometimes' if it does in any
+     */
+    void turnoverBounds(std::vector<bool>& always, std::vector<bool>& sometimes) const {
+        always.assign(window, true);
+        sometimes.assign(window, false);
+        for (size_t cls = 0; cls < members.size(); cls++) {
+            for (size_t t = 0; t < window; t++) {
+                bool step = turnoverAt(cls, t);
+                always[t] = always[t] && step;
+                sometimes[t] = sometimes[t] || step;
+            }
+        }
+    }
+    
+    /**
+     * Offsets of the left, middle and right wheels at key press t for a
+     * class and start offsets, as a positional index for an engine
+     * compiled with all rings at A, where positions equal offsets (see
+     * CompiledEnigma::stateOfPositionalIndex)
+     */
+    std::uint32_t offsetState(int cls, int left, int middle, int right, size_t t) const {
+        std::uint32_t index = (left + leftSteps[cls][t]) % ALPHABET_SIZE;
+        index = index * ALPHABET_SIZE + (middle + middleSteps[cls][t]) % ALPHABET_SIZE;
+        return index * ALPHABET_SIZE + (right + t + 1) % ALPHABET_SIZE;
+    }
+};
+
+/**
+ * Concrete wheel positions and ring settings, left to right
+ */
+struct KeySetting {
+    int positions[3];
+    int rings[3];
+};
+
+/**
+ * A surviving equivalence class: turnover class plus start offsets
+ */
+struct KeyClassHit {
+    int turnoverClass;
+    int offsets[3];
+};
+
+/**
+ * Key search over positions and ring settings by equivalence class.
+ * Settings that give the same offsets and the same turnovers inside the
+ * crib window encrypt the window identically, so each class is tested
+ * once against the crib on an engine compiled with all rings at A (with
+ * the machine's plugboard), and only the hits are expanded back into
+ * every concrete setting they stand for. The 26^6 settings of a wheel
+ * order shrink to 26^3 times the number of turnover classes.
+ */
+class KeyClassSearch {
+private:
+    static const size_t SHARD_CLASSES = 4;
+    
+    std::vector<std::uint8_t> cipher;
+    std::vector<std::uint8_t> crib;
+    size_t position;
+    TurnoverClasses classes;
+    CompiledEnigma engine;
+    
+    static EnigmaMachine withRingsAtA(EnigmaMachine machine) {
+        machine.setRingSettings(0, 0, 0);
+        return machine;
+    }
+    
+    bool matches(const CompiledEnigma& engine, int cls, int left, int middle, int right) const {
+        const std::uint8_t* plugIn = engine.plugTable(true);
+        const std::uint8_t* plugOut = engine.plugTable(false);
+        
+        for (size_t k = 0; k < crib.size(); k++) {
+            size_t t = position + k;
+            std::uint32_t state = engine.stateOfPositionalIndex(classes.offsetState(cls, left, middle, right, t));
+            const std::uint8_t* table = engine.scramblerTable(state);
+            if (plugOut[table[plugIn[crib[k]]]] != cipher[t]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+public:
+    /**
+     * Search for the machine's wheel order, reflector and plugboard, with
+     * the crib standing at letter 'position' of the ciphertext
+     */
+    KeyClassSearch(const EnigmaMachine& machine, const std::string& ciphertext, const std::string& crib,
+                   size_t position = 0)
+        : cipher(lettersOf(ciphertext)), crib(lettersOf(crib)), position(position),
+          classes(machine, position + this->crib.size()), engine(withRingsAtA(machine)) {
+        if (this->crib.empty() || position + this->crib.size() > cipher.size()) {
+            throw std::invalid_argument("Crib must lie within the ciphertext");
+        }
+    }
+    
+    const TurnoverClasses& getClasses() const {
+        return classes;
+    }
+    
+    /**
+     * Number of crib tests a run makes: one per class and start offsets
+     */
+    std::uint64_t getClassCount() const {
+        return classes.getClassCount() * static_cast<std::uint64_t>(ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE);
+    }
+    
+    /**
+     * Test every equivalence class against the crib
+     */
+    std::vector<KeyClassHit> run(unsigned workers = defaultWorkerCount()) const {
+        workers = std::max(workers, 1u);
+        std::vector<std::vector<KeyClassHit>> found(workers);
+        std::atomic<size_t> nextShard(0);
+        size_t count = classes.getClassCount();
+        NodeReplicas<CompiledEnigma> engines(engine);
+        
+        runWorkers(workers, [&](unsigned worker) {
+            const CompiledEnigma& localEngine = engines.forWorker(worker);
+            
+            for (;;) {
+                size_t begin = nextShard.fetch_add(SHARD_CLASSES);
+                if (begin >= count) break;
+                size_t end = std::min(count, begin + SHARD_CLASSES);
+                
+                for (size_t cls = begin; cls < end; cls++) {
+                    for (int left = 0; left < ALPHABET_SIZE; left++) {
+                        for (int middle = 0; middle < ALPHABET_SIZE; middle++) {
+                            for (int right = 0; right < ALPHABET_SIZE; right++) {
+                                if (matches(localEngine, cls, left, middle, right)) {
+                                    KeyClassHit hit = {static_cast<int>(cls), {left, middle, right}};
+                                    found[worker].push_back(hit);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+        
+        std::vector<KeyClassHit> hits;
+        for (const auto& local : found) {
+            hits.insert(hits.end(), local.begin(), local.end());
+        }
+        std::sort(hits.begin(), hits.end(), [](const KeyClassHit& a, const KeyClassHit& b) {
+            return std::lexicographical_compare(a.offsets, a.offsets + 3, b.offsets, b.offsets + 3) ||
+                   (std::equal(a.offsets, a.offsets + 3, b.offsets) && a.turnoverClass < b.turnoverClass);
+        });
+        return hits;
+    }
+    
+    /**
+     * Every concrete (position, ring) setting a class hit stands for;
+     * they agree over the crib window and may part at later turnovers
+     */
+    std::vector<KeySetting> expand(const KeyClassHit& hit) const {
+        std::vector<KeySetting> settings;
+        
+        for (const auto& positions : classes.getMembers(hit.turnoverClass)) {
+            for (int left = 0; left < ALPHABET_SIZE; left++) {
+                KeySetting setting;
+                setting.positions[0] = left;
+                setting.positions[1] = positions.first;
+                setting.positions[2] = positions.second;
+                for (int i = 0; i < 3; i++) {
+                    setting.rings[i] = (setting.positions[i] - hit.offsets[i] + ALPHABET_SIZE) % ALPHABET_SIZE;
+                }
+                settings.push_back(setting);
+            }
+        }
+        
+        return settings;
+    }
+};
+
+/**
+ * Rejewski's characteristic of a day's key. Every message key was sent
+ * twice at the ground setting, so key presses 1 and 4 (2 and 5, 3 and 6)
+ * enciphered the same letter, and the products AD, BE and CF of the
+ * machine permutations at those presses map the first encipherment of
+ * each key letter to the second. The plugboard only relabels their
+ * cycles, so the three cycle types identify wheel order and ground
+ * setting whatever the cabling.
+ */
+struct CycleCharacteristic {
+    std::vector<int> cycleTypes[3];     // AD, BE, CF, longest cycle first
+    
+    bool operator<(const CycleCharacteristic& other) const {
+        return std::lexicographical_compare(cycleTypes, cycleTypes + 3, other.cycleTypes, other.cycleTypes + 3);
+    }
+    
+    bool operator==(const CycleCharacteristic& other) const {
+        return std::equal(cycleTypes, cycleTypes + 3, other.cycleTypes);
+    }
+    
+    std::string toString() const {
+        std::string result;
+        for (int i = 0; i < 3; i++) {
+            result += i ? " / " : "";
+            for (size_t c = 0; c < cycleTypes[i].size(); c++) {
+                result += (c ? " " : "") + std::to_string(cycleTypes[i][c]);
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * The products AD, BE and CF rebuilt from intercepted six-letter
+ * indicators (a doubled message key enciphered at the ground setting).
+ * Each indicator fixes one letter of each product; a day's traffic of
+ * around 80 messages usually completes all three.
+ */
+class IndicatorAnalysis {
+private:
+    int links[3][ALPHABET_SIZE];
+    size_t indicatorCount;
+    
+public:
+    IndicatorAnalysis() : indicatorCount(0) {
+        std::fill(&links[0][0], &links[0][0] + 3 * ALPHABET_SIZE, -1);
+    }
+    
+    void addIndicator(const std::string& indicator) {
+        if (indicator.size() != 6 || !std::all_of(indicator.begin(), indicator.end(), [](char c) {
+                return isAsciiLetter(c);
+            })) {
+            throw std::invalid_argument("Indicator must be six letters");
+        }
+        
+        for (int i = 0; i < 3; i++) {
+            int first = charToIndex(indicator[i]);
+            int second = charToIndex(indicator[i + 3]);
+            if (links[i][first] >= 0 && links[i][first] != second) {
+                throw std::invalid_argument("Indicator " + indicator + " contradicts earlier indicators");
+            }
+            links[i][first] = second;
+        }
+        indicatorCount++;
+    }
+    
+    size_t getIndicatorCount() const {
+        return indicatorCount;
+    }
+    
+    bool isComplete() const {
+        return std::find(&links[0][0], &links[0][0] + 3 * ALPHABET_SIZE, -1) == &links[0][0] + 3 * ALPHABET_SIZE;
+    }
+    
+    /**
+     * Product 0 (AD) to 2 (CF); only once complete
+     */
+    Permutation product(int index) const {
+        if (!isComplete()) {
+            throw std::invalid_argument("Indicators do not yet cover every letter");
+        }
+        std::uint8_t table[ALPHABET_SIZE];
+        for (int letter = 0; letter < ALPHABET_SIZE; letter++) {
+            table[letter] = static_cast<std::uint8_t>(links[index][letter]);
+        }
+        return Permutation::fromTable(table, ALPHABET_SIZE);
+    }
+    
+    CycleCharacteristic characteristic() const {
+        CycleCharacteristic result;
+        for (int i = 0; i < 3; i++) {
+            result.cycleTypes[i] = product(i).cycleType();
+        }
+        return result;
+    }
+};
+
+/**
+ * Rejewski's card catalogue for one wheel order: the characteristic of
+ * every ground setting, worked out from the compiled scrambler tables
+ * (the plugboard does not change it) and indexed by characteristic.
+ * Stepping, including middle wheel turnovers, is the engine's own.
+ */
+class CharacteristicCatalog {
+private:
+    std::map<CycleCharacteristic, std::vector<std::uint32_t>> settings;
+    
+public:
+    explicit CharacteristicCatalog(const CompiledEnigma& engine) {
+        for (std::uint32_t ground = 0; ground < engine.getNumStates(); ground++) {
+            Permutation presses[6];
+            std::uint32_t state = ground;
+            for (int press = 0; press < 6; press++) {
+                state = engine.nextState(state);
+                presses[press] = Permutation::fromTable(engine.scramblerTable(state), ALPHABET_SIZE);
+            }
+            
+            CycleCharacteristic characteristic;
+            for (int i = 0; i < 3; i++) {
+                characteristic.cycleTypes[i] = presses[i].then(presses[i + 3]).cycleType();
+            }
+            settings[characteristic].push_back(ground);
+        }
+    }
+    
+    /**
+     * Ground settings (engine states before the first key press) with
+     * the characteristic; empty if none
+     */
+    std::vector<std::uint32_t> lookup(const CycleCharacteristic& characteristic) const {
+        auto found = settings.find(characteristic);
+        return found == settings.end() ? std::vector<std::uint32_t>() : found->second;
+    }
+    
+    size_t getCharacteristicCount() const {
+        return settings.size();
+    }
+};
+
+/**
+ * Summary of a statistical test battery run
+ */
+struct StatisticsReport {
+    std::uint64_t letters;
+    std::uint64_t keys;
+    double chiSquare;               // letter-frequency flatness, 25 degrees of freedom
+    double indexOfCoincidence;      // 1/26 = 0.0385 for flat output
+    double serialCorrelation;       // between consecutive letters, near 0 for good output
+    std::uint64_t selfEncryptions;  // letters encrypted to themselves, 0 for Enigma
+    double seconds;
+};
+
+/**
+ * Statistical test battery for machine output. Workers draw random
+ * Enigma I keys, encrypt a repeating plaintext pattern through the batch
+ * engine block by block and fold each block into streaming statistics,
+ * so no ciphertext is ever stored.
+ */
+class StatisticalTestBattery {
+private:
+    static const size_t BLOCK = 4096;
+    static const size_t KEYS_PER_COMPILE = 256;
+    
+    std::vector<std::uint8_t> pattern;
+    std::uint64_t lettersPerKey;
+    std::uint64_t seed;
+    
+    struct Totals {
+        LetterHistogram histogram;
+        std::uint64_t letters = 0;
+        std::uint64_t keys = 0;
+        std::uint64_t sum = 0;
+        std::uint64_t sumSquares = 0;
+        std::uint64_t sumProducts = 0;
+        std::uint64_t selfEncryptions = 0;
+    };
+    
+    void runWorker(std::uint64_t quota, unsigned worker, Totals& totals) const {
+        std::mt19937_64 rng(seed + worker);
+        std::uniform_int_distribution<int> letter(0, ALPHABET_SIZE - 1);
+        
+        // Plaintext blocks are windows of the pattern repeated past BLOCK
+        std::vector<std::uint8_t> plain;
+        while (plain.size() < BLOCK + pattern.size()) {
+            plain.insert(plain.end(), pattern.begin(), pattern.end());
+        }
+        std::vector<std::uint8_t> cipher(BLOCK);
+        
+        while (totals.letters < quota) {
+            // One compiled wheel order and ring setting serves several keys
+            EnigmaMachine machine = EnigmaFactory::createRandomEnigmaI(rng);
+            CompiledEnigma engine(machine);
+            EnigmaBatch batch(engine);
+            
+            for (size_t k = 0; k < KEYS_PER_COMPILE; k++) {
+                std::uint32_t start = engine.stateIndex(letter(rng), letter(rng), letter(rng));
+                batch.addKey(start, EnigmaFactory::createRandomPlugboard(rng));
+            }
+            
+            for (size_t lane = 0; lane < batch.size() && totals.letters < quota; lane++) {
+                std::uint64_t remaining = std::min(lettersPerKey, quota - totals.letters);
+                size_t phase = 0;
+                int previous = -1;
+                totals.keys++;
+                
+                while (remaining > 0) {
+                    size_t length = static_cast<size_t>(std::min<std::uint64_t>(BLOCK, remaining));
+                    const std::uint8_t* input = &plain[phase];
+                    batch.encrypt(lane, input, &cipher[0], length);
+                    
+                    totals.histogram.add(&cipher[0], length);
+                    totals.selfEncryptions += countCoincidences(input, &cipher[0], length);
+                    for (size_t i = 0; i < length; i++) {
+                        int value = cipher[i];
+                        totals.sum += value;
+                        totals.sumSquares += value * value;
+                        if (previous >= 0) {
+                            totals.sumProducts += previous * value;
+                        }
+                        previous = value;
+                    }
+                    
+                    phase = (phase + length) % pattern.size();
+                    totals.letters += length;
+                    remaining -= length;
+                }
+            }
+        }
+    }
+    
+public:
+    /**
+     * The plaintext pattern defaults to the alphabet, whose flat letter
+     * frequencies let any bias in the output show up
+     */
+    explicit StatisticalTestBattery(const std::string& plaintextPattern = "ABCDEFGHIJKLMNOPQRSTUVWXYZ",
+                                    std::uint64_t lettersPerKey = 1 << 12, std::uint64_t seed = 1)
+        : pattern(lettersOf(plaintextPattern)), lettersPerKey(lettersPerKey), seed(seed) {
+        if (pattern.empty()) {
+            throw std::invalid_argument("Plaintext pattern must contain letters");
+        }
+    }
+    
+    StatisticsReport run(std::uint64_t letters, unsigned workers = defaultWorkerCount()) const {
+        if (letters == 0) {
+            throw std::invalid_argument("Statistics need at least one letter");
+        }
+        if (workers == 0) {
+            throw std::invalid_argument("Statistics need at least one worker");
+        }
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<Totals> totals(workers);
+        
+        runWorkers(workers, [&](unsigned worker) {
+            // Counters live on the worker's own node until the final copy
+            std::uint64_t quota = letters / workers + (worker < letters % workers ? 1 : 0);
+            std::unique_ptr<Totals> local(new Totals());
+            runWorker(quota, worker, *local);
+            totals[worker] = *local;
+        });
+        
+        Totals all;
+        for (const Totals& part : totals) {
+            all.histogram.merge(part.histogram);
+            all.letters += part.letters;
+            all.keys += part.keys;
+            all.sum += part.sum;
+            all.sumSquares += part.sumSquares;
+            all.sumProducts += part.sumProducts;
+            all.selfEncryptions += part.selfEncryptions;
+        }
+        
+        StatisticsReport report;
+        report.letters = all.letters;
+        report.keys = all.keys;
+        report.chiSquare = all.histogram.chiSquare();
+        report.indexOfCoincidence = all.histogram.indexOfCoincidence();
+        report.selfEncryptions = all.selfEncryptions;
+        
+        // Serial correlation coefficient as computed by the 'ent' tool
+        double n = static_cast<double>(all.letters);
+        double sum = static_cast<double>(all.sum);
+        double denominator = n * static_cast<double>(all.sumSquares) - sum * sum;
+        report.serialCorrelation = denominator != 0
+            ? (n * static_cast<double>(all.sumProducts) - sum * sum) / denominator : 0.0;
+        
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+};
+
+const size_t StatisticalTestBattery::BLOCK;
+const size_t StatisticalTestBattery::KEYS_PER_COMPILE;
+
+/**
+ * Letter count from an optional command-line argument
+ */
+std::uint64_t parseLetterCount(int argc, char* argv[], std::uint64_t fallback) {
+    if (argc <= 2) {
+        return fallback;
+    }
+    std::string text = argv[2];
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::invalid_argument("Letter count must be a number: " + text);
+    }
+    try {
+        return std::stoull(text);
+    } catch (const std::out_of_range&) {
+        throw std::invalid_argument("Letter count too large: " + text);
+    }
+}
+
+/**
+ * --stats [letters]: run the statistical test battery and print a report
+ */
+int runStatisticsMode(int argc, char* argv[]) {
+    std::uint64_t letters = parseLetterCount(argc, argv, 100000000ULL);
+    
+    std::cout << "Running statistical test battery on " << letters << " letters...\n";
+    StatisticsReport report;
+    try {
+        report = StatisticalTestBattery().run(letters);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    std::cout << "Keys:               " << report.keys << "\n";
+    std::cout << "Letters:            " << report.letters << "\n";
+    std::cout << "Chi-square (25 df): " << report.chiSquare << "\n";
+    std::cout << "Index of coinc.:    " << report.indexOfCoincidence << " (flat: " << 1.0 / ALPHABET_SIZE << ")\n";
+    std::cout << "Serial correlation: " << report.serialCorrelation << "\n";
+    std::cout << "Self-encryptions:   " << report.selfEncryptions << "\n";
+    std::cout << "Throughput:         " << report.letters / report.seconds / 1e6 << " M letters/s\n";
+    return 0;
+}
+
+/**
+ * Letters per second of one batch-engine worker per CPU, each pinned to
+ * its CPU with its own key and buffers, reading the given engine
+ */
+double measureThroughput(const CompiledEnigma& engine, const std::vector<int>& cpus, std::uint64_t letters) {
+    const size_t BLOCK = 4096;
+    std::uint64_t quota = letters / cpus.size();
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    for (size_t i = 0; i < cpus.size(); i++) {
+        threads.push_back(std::thread([&engine, &cpus, i, quota, BLOCK]() {
+            pinCurrentThread(std::vector<int>(1, cpus[i]));
+            
+            EnigmaBatch batch(engine);
+            batch.addKey(static_cast<std::uint32_t>(i * 7919) % engine.getNumStates(), Plugboard());
+            std::vector<std::uint8_t> plain(BLOCK), cipher(BLOCK);
+            for (size_t k = 0; k < BLOCK; k++) {
+                plain[k] = static_cast<std::uint8_t>(k % ALPHABET_SIZE);
+            }
+            for (std::uint64_t done = 0; done < quota; done += BLOCK) {
+                batch.encrypt(0, &plain[0], &cipher[0], BLOCK);
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return quota * cpus.size() / seconds;
+}
+
+int runNumaBenchmark(int argc, char* argv[]) {
+    std::uint64_t letters = parseLetterCount(argc, argv, 200000000ULL);
+    const NumaTopology& topology = NumaTopology::get();
+    NumaTopology::enablePinning();
+    
+    std::mt19937 rng(1);
+    CompiledEnigma engine(EnigmaFactory::createRandomEnigmaI(rng));
+    NodeReplicas<CompiledEnigma> replicas(engine);
+    
+    std::cout << "NUMA nodes: " << topology.getNodeCount() << "\n";
+    for (size_t node = 0; node < topology.getNodeCount(); node++) {
+        const std::vector<int>& cpus = topology.getCpus(node);
+        double local = measureThroughput(replicas.forNode(node), cpus, letters);
+        std::cout << "Node " << node << " (" << cpus.size() << " CPUs): "
+                  << local / 1e6 << " M letters/s on local tables";
+        
+        if (topology.getNodeCount() > 1) {
+            size_t other = (node + 1) % topology.getNodeCount();
+            double remote = measureThroughput(replicas.forNode(other), cpus, letters);
+            std::cout << ", " << remote / 1e6 << " M letters/s on node " << other << "'s tables";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+int runPrecomputeMode(int argc, char* argv[]) {
+    std::string directory = argc > 2 ? argv[2] : "enigma-tables";
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    WheelOrderCache cache(directory, EnigmaFactory::createReflectorB());
+    std::vector<std::unique_ptr<CompiledEnigma>> engines = cache.get(allWheelOrders());
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << engines.size() << " wheel orders in " << directory << ": " << cache.getLoadedCount()
+              << " loaded, " << cache.getBuiltCount() << " built, " << seconds << " s\n";
+    return 0;
+}
+
+/**
+ * Key from the command line: wheel numbers left to right ("245"), start
+ * positions ("QKW"), optional rings ("AAA") and plugboard pairs, with
+ * reflector B
+ */
+EnigmaMachine parseKey(int argc, char* argv[], int first) {
+    if (argc < first + 2) {
+        throw std::invalid_argument("Expected wheel numbers and start positions, e.g. 245 QKW");
+    }
+    std::string wheels = argv[first];
+    std::string positions = argv[first + 1];
+    std::string rings = argc > first + 2 ? argv[first + 2] : "AAA";
+    if (wheels.size() != 3 || positions.size() != 3 || rings.size() != 3) {
+        throw std::invalid_argument("Wheels, positions and rings take three characters each");
+    }
+    for (int i = 0; i < 3; i++) {
+        if (!isAsciiLetter(positions[i]) || !isAsciiLetter(rings[i])) {
+            throw std::invalid_argument("Positions and rings must be letters: " + positions + " " + rings);
+        }
+    }
+    
+    std::vector<Rotor> rotors;
+    for (int i = 0; i < 3; i++) {
+        rotors.push_back(EnigmaFactory::createRotor(wheels[i] - '0'));
+    }
+    EnigmaMachine machine(rotors, EnigmaFactory::createReflectorB());
+    machine.setRotorPositions(charToIndex(positions[0]), charToIndex(positions[1]), charToIndex(positions[2]));
+    machine.setRingSettings(charToIndex(rings[0]), charToIndex(rings[1]), charToIndex(rings[2]));
+    
+    std::vector<std::pair<char, char>> pairs;
+    for (int i = first + 3; i < argc; i++) {
+        std::string pair = argv[i];
+        if (pair.size() != 2) {
+            throw std::invalid_argument("Plugboard pairs take two letters: " + pair);
+        }
+        pairs.push_back(std::make_pair(pair[0], pair[1]));
+    }
+    machine.setPlugboardConnections(pairs);
+    return machine;
+}
+
+/**
+ * Encrypt (or decrypt) standard input to standard output in chunks,
+ * through the UTF-8 front end and the table engine
+ */
+int runEncryptMode(int argc, char* argv[]) {
+    const size_t CHUNK = 1 << 16;
+    CompiledEnigma engine(parseKey(argc, argv, 2));
+    Utf8Transliterator front;
+    std::vector<char> input(CHUNK);
+    std::string text;
+    
+    while (std::cin.read(&input[0], CHUNK) || std::cin.gcount() > 0) {
+        size_t length = static_cast<size_t>(std::cin.gcount());
+        
+        // ASCII chunks are encrypted in the read buffer itself
+        if (front.acceptAscii(&input[0], length)) {
+            engine.encryptInPlace(&input[0], length);
+            std::cout.write(&input[0], length);
+            continue;
+        }
+        
+        text.clear();
+        front.feed(&input[0], length, text);
+        engine.encryptInPlace(text);
+        std::cout.write(text.data(), text.size());
+    }
+    front.finish();
+    return 0;
+}
+
+/**
+ * Encrypt (or decrypt) a file where it lies, through a shared writable
+ * mapping where available and read-modify-write otherwise. Letters change
+ * in place and everything else, non-ASCII text included, is left as it
+ * is: transliteration would change the file's length. Backward, the key's
+ * positions are those after the file's last letter.
+ */
+int runEncryptFileMode(int argc, char* argv[], bool backward) {
+    if (argc < 3) {
+        throw std::invalid_argument("Expected a file name and a key");
+    }
+    std::string path = argv[2];
+    CompiledEnigma engine(parseKey(argc, argv, 3));
+    auto process = [&engine, backward](char* text, size_t length) {
+        if (backward) {
+            engine.encryptInPlaceBackward(text, length);
+        } else {
+            engine.encryptInPlace(text, length);
+        }
+    };
+    
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDWR);
+    struct stat info;
+    if (fd >= 0 && fstat(fd, &info) == 0) {
+        size_t length = static_cast<size_t>(info.st_size);
+        void* block = length > 0 ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : nullptr;
+        close(fd);
+        if (length == 0) {
+            return 0;
+        }
+        if (block != MAP_FAILED) {
+            madvise(block, length, MADV_SEQUENTIAL);
+            process(static_cast<char*>(block), length);
+            munmap(block, length);
+            return 0;
+        }
+    } else if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    
+    std::string text;
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot read " + path);
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        text = contents.str();
+    }
+    if (!text.empty()) {
+        process(&text[0], text.size());
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(text.data(), text.size())) {
+        throw std::runtime_error("Cannot write " + path);
     }
-};
+    return 0;
+}
 
 /**
- * Plugboard class - implements the cable connections
+ * Letters per second decrypting short messages from random start states,
+ * the access pattern of a key search
  */
-class Plugboard {
-private:
-    std::map<char, char> connections;
-    
-public:
-    Plugboard() = default;
+double measureLayout(const EnigmaMachine& machine, TableLayout layout, std::uint64_t letters, bool backward = false) {
+    const size_t MESSAGE = 256;
+    CompiledEnigma engine(machine, false, layout);
+    std::mt19937 rng(1);
+    std::vector<std::uint8_t> plain(MESSAGE), cipher(MESSAGE);
+    for (size_t i = 0; i < MESSAGE; i++) {
+        plain[i] = static_cast<std::uint8_t>(rng() % ALPHABET_SIZE);
+    }
     
-    void connect(char a, char b) {
-        a = std::toupper(a);
-        b = std::toupper(b);
-        
-        // Check if letters are already connected
-        if (connections.find(a) != connections.end() || connections.find(b) != connections.end()) {
-            throw std::invalid_argument("One or both letters are already connected");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::uint64_t checksum = 0;
+    for (std::uint64_t done = 0; done < letters; done += MESSAGE) {
+        engine.setState(rng() % engine.getNumStates());
+        if (backward) {
+            engine.encryptBlockBackward(&plain[0], &cipher[0], MESSAGE);
+        } else {
+            engine.encryptBlock(&plain[0], &cipher[0], MESSAGE);
         }
-        
-        connections[a] = b;
-        connections[b] = a;
+        checksum += cipher[MESSAGE - 1];
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     
-    void clearConnections() {
-        connections.clear();
+    return checksum ? letters / seconds : 0.0;
+}
+
+/**
+ * Letters per second of a batch of random keys, lane by lane or
+ * interleaved with prefetch
+ */
+double measureBatch(const CompiledEnigma& engine, bool interleaved, std::uint64_t letters) {
+    const size_t KEYS = 64, MESSAGE = 256;
+    std::mt19937 rng(1);
+    EnigmaBatch batch(engine);
+    std::vector<std::vector<std::uint8_t>> plain(KEYS, std::vector<std::uint8_t>(MESSAGE));
+    std::vector<std::vector<std::uint8_t>> cipher(KEYS, std::vector<std::uint8_t>(MESSAGE));
+    std::vector<const std::uint8_t*> inputs;
+    std::vector<std::uint8_t*> outputs;
+    for (size_t k = 0; k < KEYS; k++) {
+        for (auto& letter : plain[k]) {
+            letter = static_cast<std::uint8_t>(rng() % ALPHABET_SIZE);
+        }
+        inputs.push_back(&plain[k][0]);
+        outputs.push_back(&cipher[k][0]);
     }
     
-    char process(char input) {
-        input = std::toupper(input);
-        
-        // If connected, return the paired letter
-        auto it = connections.find(input);
-        if (it != connections.end()) {
-            return it->second;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (std::uint64_t done = 0; done < letters; done += KEYS * MESSAGE) {
+        batch.clear();
+        for (size_t k = 0; k < KEYS; k++) {
+            batch.addKey(rng() % engine.getNumStates(), Plugboard());
+        }
+        if (interleaved) {
+            batch.encryptLanes(&inputs[0], &outputs[0], MESSAGE);
+        } else {
+            for (size_t k = 0; k < KEYS; k++) {
+                batch.encrypt(k, inputs[k], outputs[k], MESSAGE);
+            }
         }
-        
-        // Otherwise, return the input unchanged
-        return input;
     }
+    return letters / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int runLayoutBenchmark(int argc, char* argv[]) {
+    std::uint64_t letters = parseLetterCount(argc, argv, 100000000ULL);
+    std::vector<EnigmaMachine> machines = {EnigmaFactory::createEnigmaK(), EnigmaFactory::createEnigmaG()};
+    const char* names[] = {"Enigma K (17576 states)", "Enigma G (456976 states)"};
     
-    std::string getConnections() const {
-        std::string result;
-        std::vector<bool> added(ALPHABET_SIZE, false);
+    for (size_t i = 0; i < machines.size(); i++) {
+        double positional = measureLayout(machines[i], TableLayout::Positional, letters);
+        double stepping = measureLayout(machines[i], TableLayout::SteppingOrder, letters);
+        double backward = measureLayout(machines[i], TableLayout::SteppingOrder, letters, true);
+        std::cout << names[i] << ": positional " << positional / 1e6 << " M letters/s, stepping order "
+                  << stepping / 1e6 << " M letters/s, backward " << backward / 1e6 << " M letters/s\n";
         
-        for (const auto& pair : connections) {
-            char a = pair.first;
-            char b = pair.second;
-            
-            if (!added[charToIndex(a)]) {
-                result += a;
-                result += b;
-                result += " ";
-                added[charToIndex(a)] = true;
-                added[charToIndex(b)] = true;
-            }
+        for (TableLayout layout : {TableLayout::SteppingOrder, TableLayout::Positional}) {
+            CompiledEnigma engine(machines[i], false, layout);
+            double byLane = measureBatch(engine, false, letters);
+            double prefetched = measureBatch(engine, true, letters);
+            std::cout << "  batch of 64 keys, " << (layout == TableLayout::Positional ? "positional" : "stepping order")
+                      << ": lane by lane " << byLane / 1e6 << " M letters/s, interleaved with prefetch "
+                      << prefetched / 1e6 << " M letters/s\n";
         }
-        
-        return result;
     }
-};
+    return 0;
+}
 
 /**
- * Main Enigma Machine class
+ * Random text of the alphabet's symbols, with a space now and then
  */
-class EnigmaMachine {
-private:
-    std::vector<Rotor> rotors;
-    Reflector reflector;
-    Plugboard plugboard;
-    
-    // Rotate the rotors according to Enigma stepping mechanism
-    void rotateRotors() {
-        // Always rotate the rightmost rotor
-        rotors[2].rotate();
-        
-        // Check for double-stepping and notch positions
-        bool rotateMiddle = rotors[2].isAtNotch();
-        bool rotateLeft = rotors[1].isAtNotch();
-        
-        // Double-stepping mechanism
-        if (rotateMiddle) {
-            rotors[1].rotate();
-            rotors[0].rotate(); // Left rotor also rotates when middle rotor is at notch
-        }
-        
-        // Normal notch-triggered rotation
-        if (rotateLeft) {
-            rotors[0].rotate();
-        }
+template <class Alphabet>
+std::string randomSymbols(std::mt19937& rng, size_t length) {
+    std::string text;
+    for (size_t i = 0; i < length; i++) {
+        text += rng() % 16 ? Alphabet::toChar(static_cast<int>(rng() % Alphabet::size)) : ' ';
     }
-    
-public:
-    EnigmaMachine(const std::vector<Rotor>& rotors, const Reflector& reflector)
-        : rotors(rotors), reflector(reflector) {
-        if (rotors.size() != 3) {
-            throw std::invalid_argument("Enigma machine requires exactly 3 rotors");
+    return text;
+}
+
+/**
+ * Compiled (both table layouts) against interpreted encryption, from the
+ * machine's current positions
+ */
+template <class Alphabet>
+bool compiledMatchesMachine(const BasicEnigmaMachine<Alphabet>& machine, const std::string& text) {
+    BasicEnigmaMachine<Alphabet> reference(machine);
+    std::string expected = reference.encrypt(text);
+    BasicCompiledEnigma<Alphabet> stepping(machine, false, TableLayout::SteppingOrder);
+    BasicCompiledEnigma<Alphabet> positional(machine, false, TableLayout::Positional);
+    return stepping.encrypt(text) == expected && positional.encrypt(text) == expected;
+}
+
+/**
+ * --self-test: equivalence and round-trip checks of the engines on every
+ * machine variant. Prints one line per check and exits 1 if any failed.
+ */
+int runSelfTestMode() {
+    std::mt19937 rng(1918);
+    int failures = 0;
+    auto check = [&failures](const std::string& name, bool passed) {
+        std::cout << (passed ? "pass  " : "FAIL  ") << name << "\n";
+        if (!passed) {
+            failures++;
         }
+    };
+    
+    std::vector<EnigmaMachine> machines;
+    std::vector<std::string> names;
+    for (int i = 1; i <= 3; i++) {
+        machines.push_back(EnigmaFactory::createRandomEnigmaI(rng));
+        names.push_back("Enigma I #" + std::to_string(i));
     }
+    machines.push_back(EnigmaFactory::createEnigmaK());
+    names.push_back("Enigma K");
+    machines.push_back(EnigmaFactory::createEnigmaD());
+    names.push_back("Enigma D");
+    machines.push_back(EnigmaFactory::createRailwayEnigma());
+    names.push_back("Railway Enigma");
+    machines.push_back(EnigmaFactory::createEnigmaG());
+    names.push_back("Enigma G");
+    machines.push_back(EnigmaFactory::createEnigmaT());
+    names.push_back("Enigma T");
+    machines.push_back(EnigmaFactory::createTypex());
+    names.push_back("Typex");
     
-    char encryptChar(char input) {
-        // Step 1: Rotate rotors before encryption
-        rotateRotors();
+    for (size_t m = 0; m < machines.size(); m++) {
+        EnigmaMachine& machine = machines[m];
+        machine.setRotorPositions(static_cast<int>(rng() % ALPHABET_SIZE), static_cast<int>(rng() % ALPHABET_SIZE),
+                                  static_cast<int>(rng() % ALPHABET_SIZE));
+        std::string text = randomSymbols<LatinAlphabet>(rng, 3000);
+        const std::string& name = names[m];
         
-        // Step 2: Plugboard transformation
-        char result = plugboard.process(input);
+        check(name + ": compiled engine matches machine", compiledMatchesMachine(machine, text));
         
-        // Step 3: Forward pass through rotors (right to left)
-        for (int i = rotors.size() - 1; i >= 0; i--) {
-            result = rotors[i].process(result, true);
-        }
+        EnigmaMachine forward(machine);
+        std::string cipher = forward.encrypt(text);
+        EnigmaMachine reverse(machine);
+        check(name + ": decryption restores plaintext", reverse.encrypt(cipher) == text);
         
-        // Step 4: Reflector
-        result = reflector.process(result);
+        EnigmaMachine inPlace(machine);
+        std::string buffer = text;
+        inPlace.encryptInPlace(buffer);
+        CompiledEnigma engine(machine);
+        std::string engineBuffer = text;
+        engine.encryptInPlace(engineBuffer);
+        check(name + ": encryptInPlace matches encrypt", buffer == cipher && engineBuffer == cipher);
         
-        // Step 5: Backward pass through rotors (left to right)
-        for (size_t i = 0; i < rotors.size(); i++) {
-            result = rotors[i].process(result, false);
-        }
+        EnigmaMachine saved(machine);
+        EnigmaMachine::Snapshot before = saved.snapshot();
+        saved.encrypt(text);
+        saved.restore(before);
+        EnigmaMachine::Snapshot after = saved.snapshot();
+        check(name + ": restore returns to snapshot",
+              std::memcmp(&before, &after, sizeof(before)) == 0 && saved.encrypt(text) == cipher);
         
-        // Step 6: Plugboard again
-        result = plugboard.process(result);
+        bool unstepped = true;
+        EnigmaMachine stepper(machine);
+        for (int trial = 0; trial < 1000 && unstepped; trial++) {
+            stepper.setRotorPositions(static_cast<int>(rng() % ALPHABET_SIZE), static_cast<int>(rng() % ALPHABET_SIZE),
+                                      static_cast<int>(rng() % ALPHABET_SIZE));
+            EnigmaMachine::Snapshot start = stepper.snapshot();
+            stepper.step();
+            stepper.unstep();
+            EnigmaMachine::Snapshot end = stepper.snapshot();
+            unstepped = std::memcmp(&start, &end, sizeof(start)) == 0;
+        }
+        for (std::uint32_t state = 0; state < engine.getNumStates() && unstepped; state++) {
+            unstepped = engine.previousState(engine.nextState(state)) == state;
+        }
+        check(name + ": unstep reverses step", unstepped);
         
-        return result;
-    }
-    
-    std::string encrypt(const std::string& message) {
-        std::string result;
+        std::string retraced = forward.encryptBackward(cipher);
+        EnigmaMachine::Snapshot rewound = forward.snapshot();
+        check(name + ": backward encryption retraces forward",
+              retraced == text && std::memcmp(&rewound, &before, sizeof(before)) == 0);
         
-        for (char c : message) {
-            if (std::isalpha(c)) {
-                result += encryptChar(c);
-            } else {
-                // Non-alphabetic characters are passed through unchanged
-                result += c;
-            }
+        // The compiled engine ended at the message's last state after encryptInPlace
+        std::uint32_t engineStart = CompiledEnigma(machine).getState();
+        std::uint32_t engineEnd = engine.getState();
+        bool engineRetraced = engine.encryptBackward(cipher) == text && engine.getState() == engineStart;
+        std::vector<std::uint8_t> cipherSymbols = lettersOf(cipher), plainSymbols(cipherSymbols.size());
+        engine.setState(engineEnd);
+        if (!cipherSymbols.empty()) {
+            engine.encryptBlockBackward(&cipherSymbols[0], &plainSymbols[0], cipherSymbols.size());
         }
-        
-        return result;
+        engineRetraced = engineRetraced && plainSymbols == lettersOf(text) && engine.getState() == engineStart;
+        check(name + ": compiled backward encryption retraces forward", engineRetraced);
     }
     
-    void setRotorPositions(int left, int middle, int right) {
-        rotors[0].setPosition(left);
-        rotors[1].setPosition(middle);
-        rotors[2].setPosition(right);
+    // Fused index-of-coincidence kernel against the IoC of encrypt() output,
+    // across the short path's sub-histogram tail and the long path
+    bool coincidenceMatches = true;
+    CompiledEnigma iocEngine(machines[0]);
+    for (size_t length : {0, 1, 2, 3, 5, 257, 32767, 40000}) {
+        std::string text = randomSymbols<LatinAlphabet>(rng, length);
+        std::replace(text.begin(), text.end(), ' ', 'E');
+        std::vector<std::uint8_t> cipher = lettersOf(text);
+        std::uint32_t start = static_cast<std::uint32_t>(rng() % iocEngine.getNumStates());
+        
+        iocEngine.setState(start);
+        std::vector<std::uint8_t> plain = lettersOf(iocEngine.encrypt(text));
+        LetterHistogram histogram;
+        histogram.add(plain.data(), plain.size());
+        double fused = decryptIndexOfCoincidence(iocEngine, start, cipher.data(), cipher.size());
+        coincidenceMatches = coincidenceMatches && std::fabs(fused - histogram.indexOfCoincidence()) < 1e-12;
     }
+    check("Index-of-coincidence kernel matches encrypt() output", coincidenceMatches);
     
-    void setRingSettings(int left, int middle, int right) {
-        rotors[0].setRingSetting(left);
-        rotors[1].setRingSetting(middle);
-        rotors[2].setRingSetting(right);
+    // Interleaved batch lanes, each with its own key and plugboard, against
+    // a machine set to that key; more lanes than a group and not a whole
+    // number of groups, encrypted in two calls
+    const size_t LANES = 2 * EnigmaBatch::GROUP + 3;
+    CompiledEnigma batchEngine(machines[0]);
+    EnigmaBatch batch(batchEngine);
+    std::vector<EnigmaMachine> laneMachines;
+    std::vector<std::vector<std::uint8_t>> batchPlain, batchCipher;
+    for (size_t lane = 0; lane < LANES; lane++) {
+        int left = static_cast<int>(rng() % ALPHABET_SIZE);
+        int middle = static_cast<int>(rng() % ALPHABET_SIZE);
+        int right = static_cast<int>(rng() % ALPHABET_SIZE);
+        Plugboard plugboard = EnigmaFactory::createRandomPlugboard(rng);
+        batch.addKey(batchEngine.stateIndex(left, middle, right), plugboard);
+        laneMachines.push_back(machines[0]);
+        laneMachines.back().setRotorPositions(left, middle, right);
+        laneMachines.back().setPlugboard(plugboard);
+        
+        std::string text = randomSymbols<LatinAlphabet>(rng, 1000);
+        std::replace(text.begin(), text.end(), ' ', 'X');
+        batchPlain.push_back(lettersOf(text));
+        batchCipher.push_back(std::vector<std::uint8_t>(text.size()));
     }
-    
-    void setPlugboardConnections(const std::vector<std::pair<char, char>>& connections) {
-        plugboard.clearConnections();
-        for (const auto& connection : connections) {
-            plugboard.connect(connection.first, connection.second);
+    bool batchMatches = true;
+    for (size_t offset : {size_t(0), size_t(377)}) {
+        size_t length = offset ? 1000 - offset : 377;
+        std::vector<const std::uint8_t*> inputs;
+        std::vector<std::uint8_t*> outputs;
+        for (size_t lane = 0; lane < LANES; lane++) {
+            inputs.push_back(&batchPlain[lane][offset]);
+            outputs.push_back(&batchCipher[lane][offset]);
         }
+        batch.encryptLanes(&inputs[0], &outputs[0], length);
     }
-    
-    std::string getCurrentState() const {
-        std::string state;
-        state += "Rotor Positions: ";
-        state += indexToChar(rotors[0].getPosition());
-        state += indexToChar(rotors[1].getPosition());
-        state += indexToChar(rotors[2].getPosition());
-        state += "\nPlugboard: " + plugboard.getConnections();
-        return state;
+    for (size_t lane = 0; lane < LANES && batchMatches; lane++) {
+        for (size_t i = 0; i < batchPlain[lane].size() && batchMatches; i++) {
+            char expected = laneMachines[lane].encryptChar(indexToChar(batchPlain[lane][i]));
+            batchMatches = expected == indexToChar(batchCipher[lane][i]);
+        }
     }
+    check("Interleaved batch lanes match machines key by key", batchMatches);
     
-    Plugboard& getPlugboard() {
-        return plugboard;
-    }
-};
-
-/**
- * Factory functions to create historical Enigma components
- */
-namespace EnigmaFactory {
-    // Historical rotor wirings (Commercial Enigma I)
-    Rotor createRotorI(int position = 0, int ringSetting = 0) {
-        Rotor rotor("EKMFLGDQVZNTOWYHXUSPAIBRCJ", 16, "Rotor I");
-        rotor.setPosition(position);
-        rotor.setRingSetting(ringSetting);
-        return rotor;
-    }
+    typedef BasicEnigmaMachine<DigitAlphabet> DigitMachine;
+    std::vector<DigitMachine::RotorType> digitRotors = {
+        DigitMachine::RotorType("7405183962", 3), DigitMachine::RotorType("1683024759", 7),
+        DigitMachine::RotorType("9236570148", 5)
+    };
+    DigitMachine digitMachine(digitRotors, DigitMachine::ReflectorType("5798604132"));
+    digitMachine.setRotorPositions(1, 2, 3);
+    check("Digit alphabet: compiled engine matches machine",
+          compiledMatchesMachine(digitMachine, randomSymbols<DigitAlphabet>(rng, 3000)));
     
-    Rotor createRotorII(int position = 0, int ringSetting = 0) {
-        Rotor rotor("AJDKSIRUXBLHWTMCQGZNPYFVOE", 4, "Rotor II");
-        rotor.setPosition(position);
-        rotor.setRingSetting(ringSetting);
-        return rotor;
+    typedef BasicEnigmaMachine<TeleprinterAlphabet> TeleprinterMachine;
+    std::string symbols;
+    for (int i = 0; i < TeleprinterAlphabet::size; i++) {
+        symbols += TeleprinterAlphabet::toChar(i);
     }
-    
-    Rotor createRotorIII(int position = 0, int ringSetting = 0) {
-        Rotor rotor("BDFHJLCPRTXVZNYEIWGAKMUSQO", 21, "Rotor III");
-        rotor.setPosition(position);
-        rotor.setRingSetting(ringSetting);
-        return rotor;
+    std::vector<TeleprinterMachine::RotorType> teleprinterRotors;
+    for (int i = 0; i < 3; i++) {
+        std::string wiring = symbols;
+        std::shuffle(wiring.begin(), wiring.end(), rng);
+        teleprinterRotors.push_back(TeleprinterMachine::RotorType(wiring, 4 * i + 3));
     }
-    
-    // Reflector B (most common)
-    Reflector createReflectorB() {
-        return Reflector("YRUHQSLDPXNGOKMIEBFZCWVJAT", "Reflector B");
+    std::string pairing = symbols;
+    std::shuffle(pairing.begin(), pairing.end(), rng);
+    std::string reflectorWiring(symbols.size(), ' ');
+    for (size_t i = 0; i < pairing.size(); i += 2) {
+        reflectorWiring[TeleprinterAlphabet::toIndex(pairing[i])] = pairing[i + 1];
+        reflectorWiring[TeleprinterAlphabet::toIndex(pairing[i + 1])] = pairing[i];
     }
+    TeleprinterMachine teleprinterMachine(teleprinterRotors, TeleprinterMachine::ReflectorType(reflectorWiring));
+    teleprinterMachine.setRotorPositions(5, 17, 30);
+    check("Teleprinter alphabet: compiled engine matches machine",
+          compiledMatchesMachine(teleprinterMachine, randomSymbols<TeleprinterAlphabet>(rng, 3000)));
     
-    // Reflector C
-    Reflector createReflectorC() {
-        return Reflector("FVPJIAOYEDRZXWGCTKUQSBNMHL", "Reflector C");
-    }
+    std::cout << (failures ? std::to_string(failures) + " checks failed\n" : std::string("All checks passed\n"));
+    return failures ? 1 : 0;
 }
 
 /**
  * Main program with example usage
  */
-int main() {
+int main(int argc, char* argv[]) {
+    // Pin search workers to NUMA nodes for the mode that follows
+    if (argc > 1 && std::string(argv[1]) == "--numa") {
+        NumaTopology::enablePinning();
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+    
+    // Analysis and encryption modes; a bad argument or failed I/O is reported, not fatal
+    if (argc > 1 && std::string(argv[1]).compare(0, 2, "--") == 0) {
+        std::string mode = argv[1];
+        try {
+            if (mode == "--self-test") {
+                return runSelfTestMode();
+            }
+            if (mode == "--stats") {
+                return runStatisticsMode(argc, argv);
+            }
+            if (mode == "--bench-numa") {
+                return runNumaBenchmark(argc, argv);
+            }
+            if (mode == "--bench-layout") {
+                return runLayoutBenchmark(argc, argv);
+            }
+            if (mode == "--precompute") {
+                return runPrecomputeMode(argc, argv);
+            }
+            if (mode == "--encrypt") {
+                return runEncryptMode(argc, argv);
+            }
+            if (mode == "--encrypt-file" || mode == "--encrypt-file-backward") {
+                return runEncryptFileMode(argc, argv, mode == "--encrypt-file-backward");
+            }
+            throw std::invalid_argument("Unknown mode " + mode);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
     std::cout << "=========================================\n";
     std::cout << "      ENIGMA MACHINE SIMULATOR\n";
     std::cout << "=========================================\n\n";
@@ -455,11 +6097,12 @@ int main() {
         std::string sample = "THEQUICKBROWNFOXJUMPSOVERTHELAZYDOG";
         std::cout << "Original message:\n" << sample << "\n\n";
         
+        EnigmaMachine::Snapshot messageStart = enigma2.snapshot();
         std::string encryptedSample = enigma2.encrypt(sample);
         std::cout << "Encrypted message:\n" << encryptedSample << "\n\n";
         
-        // Reset and decrypt to verify
-        enigma2.setRotorPositions(5, 10, 15);
+        // Return to the snapshot and decrypt to verify
+        enigma2.restore(messageStart);
         std::string decryptedSample = enigma2.encrypt(encryptedSample);
         std::cout << "Decrypted message:\n" << decryptedSample << "\n";
         
@@ -482,13 +6125,412 @@ int main() {
         
         for (int i = 0; i < 5; i++) {
             char test = demoEnigma.encryptChar('A');
+            EnigmaMachine::Snapshot now = demoEnigma.snapshot();
             std::cout << "After encryption " << i + 1 << ": Positions: ";
-            std::cout << indexToChar(demoRotors[0].getPosition()) << " ";
-            std::cout << indexToChar(demoRotors[1].getPosition()) << " ";
-            std::cout << indexToChar(demoRotors[2].getPosition());
+            std::cout << indexToChar(now.positions[0]) << " ";
+            std::cout << indexToChar(now.positions[1]) << " ";
+            std::cout << indexToChar(now.positions[2]);
             std::cout << " (Encrypted 'A' -> '" << test << "')\n";
         }
         
+        // Checkpoint a stream and fork it: both branches continue alike
+        EnigmaMachine::Snapshot checkpoint = demoEnigma.snapshot();
+        std::string firstBranch = demoEnigma.encrypt("FORKEDSTREAM");
+        demoEnigma.restore(checkpoint);
+        std::cout << "Checkpoint at " << indexToChar(checkpoint.positions[0]) << " "
+                  << indexToChar(checkpoint.positions[1]) << " " << indexToChar(checkpoint.positions[2])
+                  << ": " << firstBranch << ", restored: " << demoEnigma.encrypt("FORKEDSTREAM") << "\n";
+        
+        // Stepping backwards: decrypt from the end, or from a known state mid-message
+        EnigmaMachine::Snapshot messageEnd = demoEnigma.snapshot();
+        std::cout << "Stepped back 12: " << demoEnigma.encryptBackward(firstBranch)
+                  << ", back at " << indexToChar(demoEnigma.snapshot().positions[0]) << " "
+                  << indexToChar(demoEnigma.snapshot().positions[1]) << " "
+                  << indexToChar(demoEnigma.snapshot().positions[2]) << "\n";
+        demoEnigma.restore(messageEnd);
+        CompiledEnigma reverseEngine(demoEnigma);
+        reverseEngine.unstep();
+        reverseEngine.unstep();
+        std::cout << "Compiled engine from 2 before the end: "
+                  << reverseEngine.encryptBackward(firstBranch.substr(0, firstBranch.size() - 2)) << "\n";
+        
+        // Uhr box: non-reciprocal steckering, one flat table per dial setting
+        std::cout << "\n=========================================\n";
+        std::cout << "UHR BOX DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        UhrBox uhr({{'A', 'B'}, {'C', 'D'}, {'E', 'F'}, {'G', 'H'}, {'I', 'J'},
+                    {'K', 'L'}, {'M', 'N'}, {'O', 'P'}, {'Q', 'R'}, {'S', 'T'}});
+        EnigmaMachine uhrEnigma(rotors, reflector);
+        
+        for (int dial : {0, 27}) {
+            uhrEnigma.setPlugboard(uhr.getPlugboard(dial));
+            uhrEnigma.setRotorPositions(0, 1, 2);
+            CompiledEnigma uhrCompiled(uhrEnigma);
+            
+            std::string cipher = uhrCompiled.encrypt(sample);
+            std::string plain = uhrEnigma.encrypt(cipher);
+            std::cout << "Dial " << dial << ": " << uhrEnigma.getPlugboard().getConnections() << "\n";
+            std::cout << "  Encrypted: " << cipher << "\n";
+            std::cout << "  Decrypted: " << plain << "\n";
+        }
+        
+        // Variant machines run on the same table-compiled engine. This only
+        // checks the compiled tables against the interpreted machine: both
+        // use the simplified ratchet model, and the Typex wiring is a stand-in.
+        std::cout << "\n=========================================\n";
+        std::cout << "VARIANT MACHINES DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        std::vector<EnigmaMachine> variants = {
+            EnigmaFactory::createEnigmaK(), EnigmaFactory::createEnigmaD(),
+            EnigmaFactory::createRailwayEnigma(), EnigmaFactory::createEnigmaG(),
+            EnigmaFactory::createEnigmaT(), EnigmaFactory::createTypex()
+        };
+        const char* variantNames[] = {"Enigma K", "Enigma D", "Railway", "Enigma G", "Enigma T", "Typex"};
+        
+        for (size_t i = 0; i < variants.size(); i++) {
+            variants[i].setRotorPositions(3, 7, 11);
+            variants[i].setReflectorPosition(5);
+            CompiledEnigma compiled(variants[i]);
+            
+            std::string cipher = compiled.encrypt(sample);
+            std::string interpreted = variants[i].encrypt(sample);
+            std::cout << variantNames[i] << ": " << cipher
+                      << (cipher == interpreted ? " (compiled == interpreted)" : " (MISMATCH)") << "\n";
+        }
+        
+        // One key stream serves every message sent on the same key
+        std::cout << "\n=========================================\n";
+        std::cout << "KEY STREAM DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        enigma2.restore(messageStart);
+        CompiledEnigma streamEngine(enigma2);
+        KeyStream keyStream(streamEngine, 64);
+        
+        std::string depthCipher1 = keyStream.apply(sample);
+        std::string depthCipher2 = keyStream.apply("ATTACKATDAWN");
+        std::cout << "Key stream of " << keyStream.size() << " positions\n";
+        std::cout << "Message 1: " << depthCipher1 << " -> " << keyStream.apply(depthCipher1) << "\n";
+        std::cout << "Message 2: " << depthCipher2 << " -> " << keyStream.apply(depthCipher2) << "\n";
+        
+        // Drag probable words over a ciphertext on known wheels and cabling
+        std::cout << "\n=========================================\n";
+        std::cout << "CRIB DRAGGING DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        CribDragger dragger(encryptedSample);
+        size_t foxCrib = dragger.addCrib("BROWNFOX");
+        dragger.addCrib("LAZYDOG");
+        dragger.addCrib("WETTERBERICHT");
+        
+        std::cout << "Ciphertext: " << encryptedSample << "\n";
+        std::cout << "BROWNFOX can stand at " << dragger.candidatePositions(foxCrib).size() << " of "
+                  << encryptedSample.size() - 7 << " positions\n";
+        for (const CribHit& hit : dragger.drag(streamEngine)) {
+            streamEngine.setState(hit.startState);
+            std::cout << "Crib " << hit.crib << " at position " << hit.position << ", start "
+                      << indexToChar(streamEngine.getRotorPosition(0)) << indexToChar(streamEngine.getRotorPosition(1))
+                      << indexToChar(streamEngine.getRotorPosition(2)) << ": "
+                      << streamEngine.encrypt(encryptedSample) << "\n";
+        }
+        
+        // Build the best menu from a crib and run it on the Bombe
+        std::cout << "\n=========================================\n";
+        std::cout << "BOMBE DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        std::vector<Rotor> bombeRotors = {
+            EnigmaFactory::createRotorII(), EnigmaFactory::createRotorIV(), EnigmaFactory::createRotorV()
+        };
+        EnigmaMachine bombeEnigma(bombeRotors, EnigmaFactory::createReflectorB());
+        bombeEnigma.setPlugboardConnections({{'A', 'Q'}, {'E', 'Z'}, {'R', 'T'}, {'N', 'M'}, {'S', 'L'},
+                                             {'I', 'O'}, {'K', 'V'}, {'D', 'G'}, {'U', 'P'}, {'B', 'X'}});
+        bombeEnigma.setRotorPositions(7, 3, 0);
+        
+        std::string bombeCrib = "WETTERVORHERSAGEFUERDIEDEUTSCHEBUCHT";
+        std::string bombeCipher = bombeEnigma.encrypt("KEINEBESONDERENEREIGNISSEX" + bombeCrib + "XENDE");
+        MenuBuilder menuBuilder(bombeCipher, bombeCrib);
+        BombeMenu menu = menuBuilder.best({26});
+        
+        std::cout << "Ciphertext: " << bombeCipher << "\n";
+        std::cout << "Menu: crib letters " << menu.begin << "-" << menu.begin + menu.length - 1 << ", "
+                  << menu.letters << " letters, " << menu.loops << " loops, test letter "
+                  << indexToChar(menu.testLetter) << ", " << menu.expectedStops << " expected false stops\n";
+        
+        const char* wheelNames[] = {"", "I", "II", "III", "IV", "V"};
+        for (const BombeStop& stop : Bombe(menu).searchWheelOrders(EnigmaFactory::createReflectorB())) {
+            std::cout << "Stop: wheels " << wheelNames[stop.wheels[0]] << " " << wheelNames[stop.wheels[1]] << " "
+                      << wheelNames[stop.wheels[2]] << " at " << indexToChar(stop.left) << indexToChar(stop.middle) << indexToChar(stop.right)
+                      << ", " << indexToChar(menu.testLetter) << " steckered to "
+                      << (stop.stecker < 0 ? '?' : indexToChar(stop.stecker)) << "\n";
+        }
+        
+        // Search positions and ring settings once per equivalence class
+        std::cout << "\n=========================================\n";
+        std::cout << "RING SETTING SEARCH DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        EnigmaMachine ringEnigma(bombeEnigma);
+        ringEnigma.setRotorPositions(11, 24, 3);
+        ringEnigma.setRingSettings(5, 17, 9);
+        std::string ringCrib = "KEINEBESONDERENEREIGNISSE";
+        std::string ringCipher = ringEnigma.encrypt(ringCrib + "X" + bombeCrib);
+        
+        KeyClassSearch classSearch(ringEnigma, ringCipher, ringCrib);
+        std::cout << "Turnover classes in " << ringCrib.size() << " letters: "
+                  << classSearch.getClasses().getClassCount() << " of 676 middle/right positions\n";
+        std::cout << "Class tests: " << classSearch.getClassCount() << " instead of "
+                  << 26ULL * 26 * 26 * 26 * 26 * 26 << " settings\n";
+        
+        for (const KeyClassHit& hit : classSearch.run()) {
+            std::vector<KeySetting> settings = classSearch.expand(hit);
+            std::cout << "Offsets " << indexToChar(hit.offsets[0]) << indexToChar(hit.offsets[1])
+                      << indexToChar(hit.offsets[2]) << ": " << settings.size() << " settings, e.g. positions "
+                      << indexToChar(settings[0].positions[0]) << indexToChar(settings[0].positions[1])
+                      << indexToChar(settings[0].positions[2]) << " rings " << indexToChar(settings[0].rings[0])
+                      << indexToChar(settings[0].rings[1]) << indexToChar(settings[0].rings[2]) << "\n";
+            
+            ringEnigma.setRotorPositions(settings[0].positions[0], settings[0].positions[1], settings[0].positions[2]);
+            ringEnigma.setRingSettings(settings[0].rings[0], settings[0].rings[1], settings[0].rings[2]);
+            std::cout << "  Decrypted: " << ringEnigma.encrypt(ringCipher) << "\n";
+        }
+        
+        // Rejewski's method: the characteristic of a day's indicators
+        // picks the ground setting out of the wheel order's catalogue
+        std::cout << "\n=========================================\n";
+        std::cout << "CYCLE CHARACTERISTIC DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        EnigmaMachine dailyEnigma(bombeRotors, EnigmaFactory::createReflectorB());
+        dailyEnigma.setPlugboardConnections({{'A', 'M'}, {'F', 'I'}, {'N', 'V'}, {'P', 'S'}, {'T', 'U'}, {'W', 'Z'}});
+        std::mt19937 keyRng(1938);
+        std::uniform_int_distribution<int> keyLetter(0, ALPHABET_SIZE - 1);
+        IndicatorAnalysis indicators;
+        while (!indicators.isComplete()) {
+            std::string messageKey;
+            for (int i = 0; i < 3; i++) {
+                messageKey += indexToChar(keyLetter(keyRng));
+            }
+            dailyEnigma.setRotorPositions(charToIndex('Q'), charToIndex('K'), charToIndex('W'));
+            indicators.addIndicator(dailyEnigma.encrypt(messageKey + messageKey));
+        }
+        
+        CompiledEnigma dailyEngine(dailyEnigma);
+        CharacteristicCatalog catalog(dailyEngine);
+        CycleCharacteristic characteristic = indicators.characteristic();
+        std::cout << indicators.getIndicatorCount() << " indicators, characteristic " << characteristic.toString() << "\n";
+        std::cout << "Catalogue for II IV V: " << catalog.getCharacteristicCount() << " characteristics over "
+                  << dailyEngine.getNumStates() << " ground settings\n";
+        std::cout << "Ground settings matching:";
+        for (std::uint32_t ground : catalog.lookup(characteristic)) {
+            std::cout << " " << indexToChar(dailyEngine.rotorPositionOf(ground, 0))
+                      << indexToChar(dailyEngine.rotorPositionOf(ground, 1))
+                      << indexToChar(dailyEngine.rotorPositionOf(ground, 2));
+        }
+        std::cout << "\n";
+        
+        // Dropped and inserted letters: resynchronize on the running score
+        std::cout << "\n=========================================\n";
+        std::cout << "GARBLED INTERCEPT DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        std::string report = "DASOBERKOMMANDODERWEHRMACHTGIBTBEKANNTDASSDIEFEINDLICHENTRUPPENAMGESTRIGENTAGE"
+                             "VERSUCHTHABENDIEFRONTIMOSTENZUDURCHBRECHENDIEANGRIFFEWURDENUNTERSCHWERENVERLUSTEN"
+                             "FUERDENGEGNERABGEWIESENUNSEREEIGENENVERBAENDEHALTENIHRESTELLUNGEN";
+        std::uint32_t reportStart = dailyEngine.stateIndex(charToIndex('R'), charToIndex('T'), charToIndex('Z'));
+        dailyEngine.setState(reportStart);
+        std::string intercept = dailyEngine.encrypt(report);
+        intercept.erase(160, 2);
+        intercept.insert(110, "XQ");
+        intercept.erase(50, 1);
+        
+        LanguageModel germanModel = LanguageModel::german();
+        GarbleTolerantDecryptor garbleDecryptor(dailyEngine, germanModel);
+        dailyEngine.setState(reportStart);
+        std::cout << "Plain decryption: " << dailyEngine.encrypt(intercept) << "\n";
+        GarbledDecryption recovered = garbleDecryptor.decryptAll({intercept}, {reportStart}).front();
+        std::cout << "Resynchronized:   " << recovered.plaintext << "\n";
+        for (const Resync& resync : recovered.resyncs) {
+            std::cout << "  letter " << resync.position;
+            if (resync.latest > resync.position) {
+                std::cout << "-" << resync.latest;
+            }
+            std::cout << ": " << std::abs(resync.skew) << (resync.skew > 0 ? " missing" : " extra") << "\n";
+        }
+        
+        // Two messages on one key stream, hidden among messages on other keys
+        std::cout << "\n=========================================\n";
+        std::cout << "DEPTH DETECTION DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        std::string supplyOrder = "ANDASGENERALKOMMANDODESZWEITENARMEEKORPSDIEVERSORGUNGDERVORDERENLINIEMITMUNITION"
+                                  "UNDVERPFLEGUNGISTBISZUMABENDSICHERZUSTELLENDIEKOLONNENMARSCHIERENBEIDUNKELHEIT"
+                                  "UEBERDIEBRUECKEBEIDEMDORFNACHOSTENDERKOMMANDEURDERNACHSCHUBTRUPPENMELDETDIE"
+                                  "ANKUNFTSOFORTWETTERFUERDIENACHTKLARUNDKALTSCHWACHERWINDAUSNORDOSTEN";
+        std::string airReport = report + "DIELUFTWAFFEHATINDENFRUEHENMORGENSTUNDENDIEBEREITSTELLUNGENDESFEINDES"
+                                         "MITSTARKENKRAEFTENANGEGRIFFEN";
+        dailyEngine.setState(reportStart);
+        KeyStream depthStream(dailyEngine, airReport.size() + supplyOrder.size());
+        DepthDetector depthDetector(4.0, 100);
+        depthDetector.addMessage(depthStream.apply(airReport));
+        depthDetector.addMessage(depthStream.apply(supplyOrder, 9));
+        dailyEngine.setState(dailyEngine.stateIndex(charToIndex('U'), charToIndex('B'), charToIndex('H')));
+        depthDetector.addMessage(dailyEngine.encrypt(supplyOrder));
+        dailyEngine.setState(dailyEngine.stateIndex(charToIndex('C'), charToIndex('C'), charToIndex('C')));
+        depthDetector.addMessage(dailyEngine.encrypt(airReport));
+        
+        std::vector<DepthMatch> depthMatches = depthDetector.findMatches(20);
+        std::cout << depthDetector.getMessageCount() << " messages compared at offsets -20..20\n";
+        for (const DepthMatch& match : depthMatches) {
+            std::cout << "Messages " << match.first << " and " << match.second << " in depth at offset " << match.offset
+                      << ": " << match.coincidences << " coincidences in " << match.overlap << " letters ("
+                      << match.sigma << " sigma)\n";
+        }
+        dailyEngine.setState(reportStart);
+        for (const DepthGroup& group : depthDetector.groupMatches(depthMatches)) {
+            std::vector<std::string> depthPlaintexts = depthDetector.decryptGroup(group, dailyEngine);
+            for (size_t i = 0; i < group.messages.size(); i++) {
+                std::cout << "  Message " << group.messages[i] << " at +" << group.offsets[i] << ": "
+                          << depthPlaintexts[i].substr(0, 48) << "...\n";
+            }
+            for (const DepthMatch& conflict : group.conflicts) {
+                std::cout << "  Conflicting match: messages " << conflict.first << " and " << conflict.second
+                          << " at offset " << conflict.offset << "\n";
+            }
+        }
+        
+        // A field rewiring of UKW-D recovered from one message on the day's key
+        std::cout << "\n=========================================\n";
+        std::cout << "UKW-D RECOVERY DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        EnigmaMachine ukwdEnigma(dailyEnigma);
+        ukwdEnigma.setReflector(EnigmaFactory::createReflectorD({{'A', 'F'}, {'B', 'O'}, {'C', 'W'}, {'D', 'U'},
+                                                                {'E', 'L'}, {'G', 'Q'}, {'H', 'Y'}, {'I', 'S'},
+                                                                {'J', 'R'}, {'K', 'T'}, {'M', 'Z'}, {'N', 'V'},
+                                                                {'P', 'X'}}));
+        ukwdEnigma.setRotorPositions(charToIndex('R'), charToIndex('T'), charToIndex('Z'));
+        std::string ukwdCipher = ukwdEnigma.encrypt(airReport + supplyOrder);
+        
+        EnigmaMachine ukwdGuess(dailyEnigma);
+        ukwdGuess.setRotorPositions(charToIndex('R'), charToIndex('T'), charToIndex('Z'));
+        UkwdSearchResult ukwdResult = UkwdSearch(ukwdGuess, ukwdCipher).run(0);
+        std::cout << "Set wiring:       " << ukwdEnigma.getReflector().getWiring() << "\n";
+        std::cout << "Recovered wiring: " << ukwdResult.reflectorWiring
+                  << (ukwdResult.reflectorWiring == ukwdEnigma.getReflector().getWiring() ? " (matches)" : " (MISMATCH)")
+                  << " from " << ukwdCipher.size() << " letters\n";
+        std::cout << "Decrypted: " << ukwdResult.plaintext.substr(0, 60) << "...\n";
+        
+        // Every start state decrypted and scored in one pass, most abandoned early
+        std::cout << "\n=========================================\n";
+        std::cout << "START STATE SEARCH DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        dailyEngine.setState(reportStart);
+        std::string searchText = dailyEngine.encrypt(report.substr(0, 100));
+        std::vector<std::uint8_t> searchCipher = lettersOf(searchText);
+        
+        // Frequencies rank the ground setting before the cabling is known,
+        // given a few hundred letters
+        dailyEngine.setState(reportStart);
+        std::vector<std::uint8_t> longCipher = lettersOf(dailyEngine.encrypt(airReport));
+        CompiledEnigma unplugged(dailyEngine);
+        unplugged.setPlugboard(Plugboard());
+        ScoringPipeline coincidencePipeline(unplugged, germanModel);
+        std::cout << "Index of coincidence over " << longCipher.size() << " letters, plugboard unknown:";
+        for (const ScoredCandidate& candidate :
+             coincidencePipeline.searchStartStatesByCoincidence(longCipher.data(), longCipher.size(), 3)) {
+            std::cout << " " << indexToChar(unplugged.rotorPositionOf(candidate.state, 0))
+                      << indexToChar(unplugged.rotorPositionOf(candidate.state, 1))
+                      << indexToChar(unplugged.rotorPositionOf(candidate.state, 2)) << " (" << candidate.score << ")";
+        }
+        std::cout << "\n";
+        
+        // The safe bound never loses the key; a tighter one prunes harder
+        double bounds[] = {germanModel.getBestStep(), (germanModel.getBestStep() + germanModel.getRandomStep()) / 2};
+        const char* boundNames[] = {"safe bound", "tight bound"};
+        std::vector<ScoredCandidate> ranked;
+        for (int b = 0; b < 2; b++) {
+            ScoringPipeline pipeline(dailyEngine, germanModel);
+            pipeline.setBoundStep(bounds[b]);
+            ranked = pipeline.searchStartStates(searchCipher.data(), searchCipher.size(), 3);
+            std::cout << boundNames[b] << ": " << dailyEngine.getNumStates() << " start states, "
+                      << pipeline.averageLettersPerCandidate() << " of " << searchCipher.size()
+                      << " letters decrypted per candidate on average\n";
+        }
+        for (const ScoredCandidate& candidate : ranked) {
+            dailyEngine.setState(candidate.state);
+            std::cout << "Start " << indexToChar(dailyEngine.getRotorPosition(0)) << indexToChar(dailyEngine.getRotorPosition(1))
+                      << indexToChar(dailyEngine.getRotorPosition(2)) << " score " << candidate.score << ": "
+                      << dailyEngine.encrypt(searchText.substr(0, 40)) << "...\n";
+        }
+        
+        // All 60 wheel orders' tables in one huge-page block, stepping-ordered
+        std::cout << "\n=========================================\n";
+        std::cout << "SCRAMBLER TABLE SET DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        ScramblerTableSet tableSet(EnigmaFactory::createReflectorB());
+        const char* backingNames[] = {"huge pages (reserved)", "transparent huge pages", "normal pages", "a mapped file"};
+        std::cout << tableSet.getOrderCount() << " wheel orders, "
+                  << tableSet.getOrderCount() * tableSet.getStatesPerOrder() * ALPHABET_SIZE / (1 << 20)
+                  << " MB on " << backingNames[static_cast<int>(tableSet.getBacking())] << "\n";
+        
+        size_t setOrder = 0;
+        while (tableSet.getWheels(setOrder) != std::array<int, 3>{{2, 4, 5}}) {
+            setOrder++;
+        }
+        std::uint32_t setState = tableSet.stateIndex(setOrder, 7, 3, 0);
+        std::string setPlain;
+        for (char c : bombeCipher) {
+            setState = tableSet.nextState(setOrder, setState);
+            char in = bombeEnigma.getPlugboard().process(c, true);
+            char out = indexToChar(tableSet.table(setOrder, setState)[charToIndex(in)]);
+            setPlain += bombeEnigma.getPlugboard().process(out, false);
+        }
+        std::cout << "Wheels II IV V from the set: " << setPlain << "\n";
+        
+        // UTF-8 input is transliterated before it reaches the cipher
+        std::cout << "\n=========================================\n";
+        std::cout << "UTF-8 FRONT END DEMONSTRATION\n";
+        std::cout << "=========================================\n\n";
+        
+        std::string germanText = "Grüße aus Köln: Übergabe der Straßenkarte um 0800 Uhr";
+        std::string keyedText = Utf8Transliterator::transliterate(germanText);
+        CompiledEnigma frontEngine(enigma);
+        std::string frontCipher = frontEngine.encrypt(keyedText);
+        frontEngine.setRotorPositions(enigma.getRotors()[0].getPosition(), enigma.getRotors()[1].getPosition(),
+                                      enigma.getRotors()[2].getPosition());
+        std::cout << "Input:      " << germanText << "\n";
+        std::cout << "Keyed as:   " << keyedText << "\n";
+        std::cout << "Encrypted:  " << frontCipher << "\n";
+        std::cout << "Decrypted:  " << frontEngine.encrypt(frontCipher) << "\n";
+        
+        // Demonstrate a non-Enigma alphabet on the same engine
+        std::cout << "\n=========================================\n";
+        std::cout << "GENERALIZED ALPHABET DEMONSTRATION\n";
+        std::cout << "=========================================\n";
+        
+        typedef BasicEnigmaMachine<DigitAlphabet> DigitMachine;
+        std::vector<DigitMachine::RotorType> digitRotors = {
+            DigitMachine::RotorType("7405183962", 3, "Digit Rotor 1"),
+            DigitMachine::RotorType("1683024759", 7, "Digit Rotor 2"),
+            DigitMachine::RotorType("9236570148", 5, "Digit Rotor 3")
+        };
+        
+        DigitMachine digitEnigma(digitRotors, DigitMachine::ReflectorType("5798604132", "Digit Reflector"));
+        digitEnigma.setRotorPositions(1, 2, 3);
+        
+        std::string digits = "0123456789 31415926";
+        std::string encryptedDigits = digitEnigma.encrypt(digits);
+        digitEnigma.setRotorPositions(1, 2, 3);
+        
+        std::cout << "\nOriginal:  " << digits << "\n";
+        std::cout << "Encrypted: " << encryptedDigits << "\n";
+        std::cout << "Decrypted: " << digitEnigma.encrypt(encryptedDigits) << "\n";
+        
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;